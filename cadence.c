@@ -0,0 +1,66 @@
+/*
+ * Cage: A Wayland kiosk.
+ *
+ * Copyright (C) 2018-2020 Jente Hidskes
+ *
+ * See the LICENSE file accompanying this file.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "cadence.h"
+#include "util.h"
+
+/* Commits further apart than this mean the content was paused, in
+ * which case whatever we measured before no longer applies. */
+#define CADENCE_MAX_INTERVAL 500000000 // nsec
+
+void
+cadence_reset(struct cg_cadence *cadence)
+{
+	memset(cadence, 0, sizeof(*cadence));
+}
+
+void
+cadence_record(struct cg_cadence *cadence, const struct timespec *when)
+{
+	bool first = cadence->last.tv_sec == 0 && cadence->last.tv_nsec == 0;
+	int64_t interval = timespec_diff_nsec(when, &cadence->last);
+	cadence->last = *when;
+
+	if (first) {
+		return;
+	}
+
+	if (interval <= 0 || interval > CADENCE_MAX_INTERVAL) {
+		cadence_reset(cadence);
+		cadence->last = *when;
+		return;
+	}
+
+	if (cadence->n == CG_CADENCE_WINDOW) {
+		cadence->sum -= cadence->intervals[cadence->next];
+	} else {
+		cadence->n++;
+	}
+	cadence->intervals[cadence->next] = interval;
+	cadence->sum += interval;
+	cadence->next = (cadence->next + 1) % CG_CADENCE_WINDOW;
+}
+
+int
+cadence_get_rate(struct cg_cadence *cadence, const struct timespec *now)
+{
+	if (cadence->n < CG_CADENCE_WINDOW || cadence->sum <= 0) {
+		return 0;
+	}
+
+	if (timespec_diff_nsec(now, &cadence->last) > CADENCE_MAX_INTERVAL) {
+		return 0;
+	}
+
+	return (int) ((int64_t) cadence->n * 1000000000000 / cadence->sum);
+}
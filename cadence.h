@@ -0,0 +1,27 @@
+#ifndef CG_CADENCE_H
+#define CG_CADENCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Number of commit intervals the estimate is averaged over. This
+ * needs to be large enough to smooth out the pulldown pattern of
+ * e.g. 24 or 25 fps content that is paced by a 60 Hz output. */
+#define CG_CADENCE_WINDOW 60
+
+/* Tracks the rate at which a client presents new content, derived
+ * from the timestamps of its commits that carry damage. */
+struct cg_cadence {
+	struct timespec last;
+	int64_t intervals[CG_CADENCE_WINDOW]; // nsec
+	int64_t sum;
+	size_t n, next;
+};
+
+void cadence_reset(struct cg_cadence *cadence);
+void cadence_record(struct cg_cadence *cadence, const struct timespec *when);
+/** Returns the estimated content rate in mHz, or 0 when it is unknown. */
+int cadence_get_rate(struct cg_cadence *cadence, const struct timespec *now);
+
+#endif
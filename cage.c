@@ -12,6 +12,7 @@
 
 #include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -40,10 +41,15 @@
 #include <wlr/xwayland.h>
 #endif
 
+#include "client.h"
 #include "idle_inhibit_v1.h"
 #include "output.h"
 #include "seat.h"
 #include "server.h"
+#ifdef DEBUG
+#include "stress.h"
+#endif
+#include "util.h"
 #include "view.h"
 #include "xdg_shell.h"
 #if CAGE_HAS_XWAYLAND
@@ -162,16 +168,132 @@ drop_permissions(void)
 	return true;
 }
 
+static int
+signal_listener_count(struct wl_signal *signal)
+{
+	return wl_list_length(&signal->listener_list);
+}
+
+/* Listeners on the signals of the backend, outputs and views. A count
+ * that keeps growing while the number of objects stays the same means
+ * listeners are leaked. */
+static int
+live_listener_count(struct cg_server *server)
+{
+	int count = signal_listener_count(&server->backend->events.new_output) +
+		    signal_listener_count(&server->backend->events.new_input) +
+		    signal_listener_count(&server->backend->events.destroy);
+
+	struct cg_output *output;
+	wl_list_for_each (output, &server->outputs, link) {
+		struct wlr_output *wlr_output = output->wlr_output;
+		count += signal_listener_count(&wlr_output->events.frame) +
+			 signal_listener_count(&wlr_output->events.commit) +
+			 signal_listener_count(&wlr_output->events.present) +
+			 signal_listener_count(&wlr_output->events.mode) +
+			 signal_listener_count(&wlr_output->events.destroy) +
+			 signal_listener_count(&output->damage->events.frame) +
+			 signal_listener_count(&output->damage->events.destroy);
+	}
+
+	struct cg_view *view;
+	wl_list_for_each (view, &server->views, link) {
+		count += signal_listener_count(&view->wlr_surface->events.commit) +
+			 signal_listener_count(&view->wlr_surface->events.new_subsurface) +
+			 signal_listener_count(&view->wlr_surface->events.destroy);
+	}
+
+	return count;
+}
+
+static void
+log_lifecycle_statistics(struct cg_server *server)
+{
+	struct cg_seat *seat = server->seat;
+
+	wlr_log(WLR_INFO, "Cage: %ld KiB resident, %d open file descriptors", proc_rss_kib(getpid()),
+		proc_fd_count(getpid()));
+	wlr_log(WLR_INFO, "Live objects: %d outputs, %d keyboard groups, %d pointers, %d touch devices",
+		wl_list_length(&server->outputs), wl_list_length(&seat->keyboard_groups),
+		wl_list_length(&seat->pointers), wl_list_length(&seat->touch));
+	wlr_log(WLR_INFO, "Live objects: %u views, %u view children", server->n_views, server->n_view_children);
+	wlr_log(WLR_INFO, "Listeners on the backend, outputs and views: %d", live_listener_count(server));
+#if CAGE_HAS_XWAYLAND
+	wlr_log(WLR_INFO, "Live objects: %u override-redirect X11 windows", server->n_xwayland_unmanaged);
+#endif
+
+	event_stats_log(&server->new_output_stats, "New output");
+	event_stats_log(&server->output_destroy_stats, "Output destroy");
+	event_stats_log(&server->new_input_stats, "New input");
+	event_stats_log(&server->view_map_stats, "View map");
+	event_stats_log(&server->view_unmap_stats, "View unmap");
+	event_stats_log(&server->view_destroy_stats, "View destroy");
+#if CAGE_HAS_XWAYLAND
+	event_stats_log(&server->xwayland_unmanaged_stats, "Override-redirect X11 window");
+#endif
+
+	event_stats_log(&seat->key_stats, "Key");
+	wlr_log(WLR_INFO, "Keys passed on without keysym lookup: %u", seat->keys_fast_path);
+}
+
+static void
+log_statistics(struct cg_server *server)
+{
+	/* Release builds only log errors, but the statistics were asked
+	   for explicitly, so they are shown regardless. */
+	enum wlr_log_importance verbosity = wlr_log_get_verbosity();
+	if (verbosity < WLR_INFO) {
+		wlr_log_init(WLR_INFO, NULL);
+	}
+
+	log_lifecycle_statistics(server);
+
+	struct cg_output *output;
+	wl_list_for_each (output, &server->outputs, link) {
+		output_log_statistics(output);
+	}
+
+	if (server->view_cache) {
+		wlr_log(WLR_INFO, "View cache: %zu KiB in use", server->view_cache_size / 1024);
+	}
+
+	struct cg_view *view;
+	wl_list_for_each (view, &server->views, link) {
+		view_log_statistics(view);
+	}
+
+	struct cg_client *client;
+	wl_list_for_each (client, &server->clients, link) {
+		client_log_statistics(client);
+	}
+
+#if CAGE_HAS_XWAYLAND
+	xwayland_log_statistics(server);
+#endif
+#ifdef DEBUG
+	if (server->stress) {
+		stress_log_statistics(server->stress);
+	}
+#endif
+
+	if (verbosity < WLR_INFO) {
+		wlr_log_init(verbosity, NULL);
+	}
+}
+
 static int
 handle_signal(int signal, void *data)
 {
-	struct wl_display *display = data;
+	struct cg_server *server = data;
 
 	switch (signal) {
 	case SIGINT:
 		/* Fallthrough */
 	case SIGTERM:
-		wl_display_terminate(display);
+		wl_display_terminate(server->wl_display);
+		return 0;
+	case SIGUSR2:
+		log_statistics(server);
 		return 0;
 	default:
 		return 0;
@@ -184,16 +306,27 @@ usage(FILE *file, const char *cage)
 	fprintf(file,
 		"Usage: %s [OPTIONS] [--] APPLICATION\n"
 		"\n"
+		" -b\t Benchmark mode: pace frame callbacks without compositing\n"
+		" -c\t Cache the static surfaces of the bottom-most view\n"
 		" -d\t Don't draw client side decorations, when possible\n"
 #ifdef DEBUG
 		" -D\t Turn on damage tracking debugging\n"
 #endif
+		" -f\t Match the output refresh rate to the frame rate of the content\n"
 		" -h\t Display this help message\n"
+#ifdef DEBUG
+		" -H ms Add and remove a headless output, keyboard and pointer every ms milliseconds\n"
+#endif
 		" -m extend Extend the display across all connected outputs (default)\n"
 		" -m last Use only the last connected output\n"
 		" -r\t Rotate the output 90 degrees clockwise, specify up to three times\n"
 		" -s\t Allow VT switching\n"
+		" -S\t Composite only new damage into a per-output shadow buffer\n"
+		" -t\t Time how long clients' shared memory commits take\n"
 		" -v\t Show the version number and exit\n"
+#if CAGE_HAS_XWAYLAND
+		" -x secs Stop Xwayland after it has been without X11 clients for secs seconds\n"
+#endif
 		"\n"
 		" Use -- when you want to pass arguments to APPLICATION\n",
 		cage);
@@ -204,11 +337,17 @@ parse_args(struct cg_server *server, int argc, char *argv[])
 {
 	int c;
 #ifdef DEBUG
-	while ((c = getopt(argc, argv, "dDhm:rsv")) != -1) {
+	while ((c = getopt(argc, argv, "bcdDfhH:m:rsStvx:")) != -1) {
 #else
-	while ((c = getopt(argc, argv, "dhm:rsv")) != -1) {
+	while ((c = getopt(argc, argv, "bcdfhm:rsStvx:")) != -1) {
 #endif
 		switch (c) {
+		case 'b':
+			server->benchmark = true;
+			break;
+		case 'c':
+			server->view_cache = true;
+			break;
 		case 'd':
 			server->xdg_decoration = true;
 			break;
@@ -217,9 +356,24 @@ parse_args(struct cg_server *server, int argc, char *argv[])
 			server->debug_damage_tracking = true;
 			break;
 #endif
+		case 'f':
+			server->match_refresh = true;
+			break;
 		case 'h':
 			usage(stdout, argv[0]);
 			return false;
+#ifdef DEBUG
+		case 'H': {
+			char *end;
+			long interval = strtol(optarg, &end, 10);
+			if (*end != '\0' || interval <= 0 || interval > INT_MAX) {
+				usage(stderr, argv[0]);
+				return false;
+			}
+			server->stress_interval = interval;
+			break;
+		}
+#endif
 		case 'm':
 			if (strcmp(optarg, "last") == 0) {
 				server->output_mode = CAGE_MULTI_OUTPUT_MODE_LAST;
@@ -236,9 +390,27 @@ parse_args(struct cg_server *server, int argc, char *argv[])
 		case 's':
 			server->allow_vt_switch = true;
 			break;
+		case 'S':
+			server->shadow_buffer = true;
+			break;
+		case 't':
+			server->time_client_commits = true;
+			break;
 		case 'v':
 			fprintf(stdout, "Cage version " CAGE_VERSION "\n");
 			exit(0);
+#if CAGE_HAS_XWAYLAND
+		case 'x': {
+			char *end;
+			long timeout = strtol(optarg, &end, 10);
+			if (*end != '\0' || timeout < 0 || timeout > INT_MAX / 1000) {
+				usage(stderr, argv[0]);
+				return false;
+			}
+			server->xwayland_idle_timeout = timeout;
+			break;
+		}
+#endif
 		default:
 			usage(stderr, argv[0]);
 			return false;
@@ -260,6 +432,7 @@ main(int argc, char *argv[])
 	struct wl_event_loop *event_loop = NULL;
 	struct wl_event_source *sigint_source = NULL;
 	struct wl_event_source *sigterm_source = NULL;
+	struct wl_event_source *sigusr2_source = NULL;
 	struct wl_event_source *sigchld_source = NULL;
 	struct wlr_renderer *renderer = NULL;
 	struct wlr_compositor *compositor = NULL;
@@ -271,10 +444,6 @@ main(int argc, char *argv[])
 	struct wlr_xdg_output_manager_v1 *output_manager = NULL;
 	struct wlr_gamma_control_manager_v1 *gamma_control_manager = NULL;
 	struct wlr_xdg_shell *xdg_shell = NULL;
-#if CAGE_HAS_XWAYLAND
-	struct wlr_xwayland *xwayland = NULL;
-	struct wlr_xcursor_manager *xcursor_manager = NULL;
-#endif
 	pid_t pid = 0;
 	int ret = 0;
 
@@ -301,8 +470,10 @@ main(int argc, char *argv[])
 	}
 
 	event_loop = wl_display_get_event_loop(server.wl_display);
-	sigint_source = wl_event_loop_add_signal(event_loop, SIGINT, handle_signal, &server.wl_display);
-	sigterm_source = wl_event_loop_add_signal(event_loop, SIGTERM, handle_signal, &server.wl_display);
+	sigint_source = wl_event_loop_add_signal(event_loop, SIGINT, handle_signal, &server);
+	sigterm_source = wl_event_loop_add_signal(event_loop, SIGTERM, handle_signal, &server);
+	/* wlroots uses SIGUSR1 to learn that Xwayland is ready. */
+	sigusr2_source = wl_event_loop_add_signal(event_loop, SIGUSR2, handle_signal, &server);
 
 	server.backend = wlr_backend_autocreate(server.wl_display);
 	if (!server.backend) {
@@ -316,6 +487,12 @@ main(int argc, char *argv[])
 		goto end;
 	}
 
+	if (!client_stats_init(&server)) {
+		wlr_log(WLR_ERROR, "Unable to set up client statistics");
+		ret = 1;
+		goto end;
+	}
+
 	renderer = wlr_backend_get_renderer(server.backend);
 	wlr_renderer_init_wl_display(renderer, server.wl_display);
 
@@ -430,36 +607,42 @@ main(int argc, char *argv[])
 	}
 
 #if CAGE_HAS_XWAYLAND
-	xwayland = wlr_xwayland_create(server.wl_display, compositor, true);
-	if (!xwayland) {
+	server.xwayland = wlr_xwayland_create(server.wl_display, compositor, true);
+	if (!server.xwayland) {
 		wlr_log(WLR_ERROR, "Cannot create XWayland server");
 		ret = 1;
 		goto end;
 	}
+	wl_list_init(&server.xwayland_unmanaged);
 	server.new_xwayland_surface.notify = handle_xwayland_surface_new;
-	wl_signal_add(&xwayland->events.new_surface, &server.new_xwayland_surface);
+	wl_signal_add(&server.xwayland->events.new_surface, &server.new_xwayland_surface);
+	server.xwayland_ready.notify = handle_xwayland_ready;
+	wl_signal_add(&server.xwayland->events.ready, &server.xwayland_ready);
 
-	xcursor_manager = wlr_xcursor_manager_create(DEFAULT_XCURSOR, XCURSOR_SIZE);
-	if (!xcursor_manager) {
+	server.xwayland_xcursor_manager = wlr_xcursor_manager_create(DEFAULT_XCURSOR, XCURSOR_SIZE);
+	if (!server.xwayland_xcursor_manager) {
 		wlr_log(WLR_ERROR, "Cannot create XWayland XCursor manager");
 		ret = 1;
 		goto end;
 	}
 
-	if (setenv("DISPLAY", xwayland->display_name, true) < 0) {
+	if (setenv("DISPLAY", server.xwayland->display_name, true) < 0) {
 		wlr_log_errno(WLR_ERROR, "Unable to set DISPLAY for XWayland. Clients may not be able to connect");
 	} else {
-		wlr_log(WLR_DEBUG, "XWayland is running on display %s", xwayland->display_name);
+		wlr_log(WLR_DEBUG, "XWayland is running on display %s", server.xwayland->display_name);
 	}
 
-	if (!wlr_xcursor_manager_load(xcursor_manager, 1)) {
+	if (!wlr_xcursor_manager_load(server.xwayland_xcursor_manager, 1)) {
 		wlr_log(WLR_ERROR, "Cannot load XWayland XCursor theme");
 	}
-	struct wlr_xcursor *xcursor = wlr_xcursor_manager_get_xcursor(xcursor_manager, DEFAULT_XCURSOR, 1);
-	if (xcursor) {
-		struct wlr_xcursor_image *image = xcursor->images[0];
-		wlr_xwayland_set_cursor(xwayland, image->buffer, image->width * 4, image->width, image->height,
-					image->hotspot_x, image->hotspot_y);
+
+	if (server.xwayland_idle_timeout > 0) {
+		server.xwayland_idle_timer = wl_event_loop_add_timer(event_loop, handle_xwayland_idle_timer, &server);
+		if (!server.xwayland_idle_timer) {
+			wlr_log(WLR_ERROR, "Unable to create the Xwayland idle timer");
+			ret = 1;
+			goto end;
+		}
 	}
 #endif
 
@@ -483,7 +666,7 @@ main(int argc, char *argv[])
 	}
 
 #if CAGE_HAS_XWAYLAND
-	wlr_xwayland_set_seat(xwayland, server.seat->seat);
+	wlr_xwayland_set_seat(server.xwayland, server.seat->seat);
 #endif
 
 	if (!spawn_primary_client(server.wl_display, argv + optind, &pid, &sigchld_source)) {
@@ -491,6 +674,26 @@ main(int argc, char *argv[])
 		goto end;
 	}
 
+	if (server.match_refresh) {
+		server.refresh_match_timer = wl_event_loop_add_timer(event_loop, handle_refresh_match_timer, &server);
+		if (!server.refresh_match_timer) {
+			wlr_log(WLR_ERROR, "Unable to create the refresh rate matching timer");
+			ret = 1;
+			goto end;
+		}
+		handle_refresh_match_timer(&server);
+	}
+
+#ifdef DEBUG
+	if (server.stress_interval > 0) {
+		server.stress = stress_create(&server, event_loop);
+		if (!server.stress) {
+			ret = 1;
+			goto end;
+		}
+	}
+#endif
+
 	/* Place the cursor in the center of the output layout. */
 	struct wlr_box *layout_box = wlr_output_layout_get_box(server.output_layout, NULL);
 	wlr_cursor_warp(server.seat->cursor, NULL, layout_box->width / 2, layout_box->height / 2);
@@ -498,16 +701,30 @@ main(int argc, char *argv[])
 	wl_display_run(server.wl_display);
 
 #if CAGE_HAS_XWAYLAND
-	wlr_xwayland_destroy(xwayland);
-	wlr_xcursor_manager_destroy(xcursor_manager);
+	wlr_xwayland_destroy(server.xwayland);
+	wlr_xcursor_manager_destroy(server.xwayland_xcursor_manager);
 #endif
 	wl_display_destroy_clients(server.wl_display);
 
 end:
+	client_stats_fini(&server);
 	cleanup_primary_client(pid);
 
 	wl_event_source_remove(sigint_source);
 	wl_event_source_remove(sigterm_source);
+	wl_event_source_remove(sigusr2_source);
+	if (server.refresh_match_timer) {
+		wl_event_source_remove(server.refresh_match_timer);
+	}
+#ifdef DEBUG
+	stress_destroy(server.stress);
+#endif
+#if CAGE_HAS_XWAYLAND
+	xwayland_probe_cancel(&server);
+	if (server.xwayland_idle_timer) {
+		wl_event_source_remove(server.xwayland_idle_timer);
+	}
+#endif
 	if (sigchld_source) {
 		wl_event_source_remove(sigchld_source);
 	}
@@ -0,0 +1,180 @@
+/*
+ * Cage: A Wayland kiosk.
+ *
+ * Copyright (C) 2018-2020 Jente Hidskes
+ *
+ * See the LICENSE file accompanying this file.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_surface.h>
+#include <wlr/util/log.h>
+
+#include "client.h"
+#include "server.h"
+#include "util.h"
+
+static void
+handle_client_destroy(struct wl_listener *listener, void *data)
+{
+	struct cg_client *client = wl_container_of(listener, client, destroy);
+
+	client_log_statistics(client);
+
+	wl_list_remove(&client->link);
+	wl_list_remove(&client->destroy.link);
+	free(client);
+}
+
+static struct cg_client *
+client_from_wl_client(struct cg_server *server, struct wl_client *wl_client)
+{
+	struct wl_listener *listener = wl_client_get_destroy_listener(wl_client, handle_client_destroy);
+	if (listener) {
+		struct cg_client *client = wl_container_of(listener, client, destroy);
+		return client;
+	}
+
+	struct cg_client *client = calloc(1, sizeof(struct cg_client));
+	if (!client) {
+		wlr_log(WLR_ERROR, "Cannot allocate client statistics");
+		return NULL;
+	}
+
+	client->server = server;
+	client->wl_client = wl_client;
+	wl_client_get_credentials(wl_client, &client->pid, NULL, NULL);
+
+	client->destroy.notify = handle_client_destroy;
+	wl_client_add_destroy_listener(wl_client, &client->destroy);
+	wl_list_insert(&server->clients, &client->link);
+
+	return client;
+}
+
+/* Requests are logged right before they are dispatched, which makes
+ * this the earliest point at which we know a commit is coming. */
+static void
+handle_protocol_message(void *user_data, enum wl_protocol_logger_type direction,
+			const struct wl_protocol_logger_message *message)
+{
+	struct cg_server *server = user_data;
+
+	if (direction != WL_PROTOCOL_LOGGER_REQUEST || strcmp(message->message->name, "commit") != 0 ||
+	    strcmp(wl_resource_get_class(message->resource), "wl_surface") != 0) {
+		return;
+	}
+
+	server->commit_surface = message->resource;
+	clock_gettime(CLOCK_MONOTONIC, &server->commit_requested);
+}
+
+static uint64_t
+shm_upload_bytes(struct wlr_surface *surface, struct wl_shm_buffer *shm_buffer)
+{
+	int32_t width = wl_shm_buffer_get_width(shm_buffer);
+	int32_t height = wl_shm_buffer_get_height(shm_buffer);
+	if (width <= 0) {
+		return 0;
+	}
+	uint64_t bytes_per_pixel = wl_shm_buffer_get_stride(shm_buffer) / width;
+
+	/* Only the damaged part of a buffer is copied into an existing
+	   texture; new textures are damaged as a whole by wlroots. */
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	pixman_region32_intersect_rect(&damage, &surface->buffer_damage, 0, 0, width, height);
+
+	uint64_t bytes = 0;
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
+	for (int i = 0; i < nrects; i++) {
+		bytes += (uint64_t) (rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1) * bytes_per_pixel;
+	}
+
+	pixman_region32_fini(&damage);
+	return bytes;
+}
+
+void
+client_record_commit(struct cg_server *server, struct wlr_surface *surface)
+{
+	if (!(surface->current.committed & WLR_SURFACE_STATE_BUFFER) || !surface->buffer ||
+	    !surface->buffer->resource) {
+		return;
+	}
+
+	struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(surface->buffer->resource);
+	if (!shm_buffer) {
+		return;
+	}
+
+	struct cg_client *client = client_from_wl_client(server, wl_resource_get_client(surface->resource));
+	if (!client) {
+		return;
+	}
+
+	client->shm_commits++;
+	client->shm_bytes += shm_upload_bytes(surface, shm_buffer);
+
+	/* Synchronized subsurfaces are applied when their parent
+	   commits, in which case the time is accounted to the parent. */
+	if (server->commit_surface == surface->resource) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		int64_t time = timespec_diff_nsec(&now, &server->commit_requested);
+		client->shm_timed_commits++;
+		client->shm_time_total += time;
+		if (time > client->shm_time_max) {
+			client->shm_time_max = time;
+		}
+		server->commit_surface = NULL;
+	}
+}
+
+void
+client_log_statistics(struct cg_client *client)
+{
+	if (client->shm_commits == 0) {
+		return;
+	}
+
+	wlr_log(WLR_INFO, "Client %d: %u SHM commits, %" PRIu64 " KiB uploaded", client->pid, client->shm_commits,
+		client->shm_bytes / 1024);
+
+	if (client->shm_timed_commits > 0) {
+		wlr_log(WLR_INFO, "Client %d: SHM commit time avg %.2f ms, max %.2f ms", client->pid,
+			client->shm_time_total / 1e6 / client->shm_timed_commits, client->shm_time_max / 1e6);
+	}
+}
+
+bool
+client_stats_init(struct cg_server *server)
+{
+	wl_list_init(&server->clients);
+
+	/* The logger sees every request and event, so it is only
+	   installed when asked for. */
+	if (!server->time_client_commits) {
+		return true;
+	}
+
+	server->protocol_logger = wl_display_add_protocol_logger(server->wl_display, handle_protocol_message, server);
+	return server->protocol_logger != NULL;
+}
+
+void
+client_stats_fini(struct cg_server *server)
+{
+	if (server->protocol_logger) {
+		wl_protocol_logger_destroy(server->protocol_logger);
+		server->protocol_logger = NULL;
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef CG_CLIENT_H
+#define CG_CLIENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_surface.h>
+
+struct cg_server;
+
+/* Per-client accounting of the work a client causes on commit. */
+struct cg_client {
+	struct cg_server *server;
+	struct wl_client *wl_client;
+	struct wl_list link; // server::clients
+	pid_t pid;
+
+	/* Commits that attached a wl_shm buffer, which wlroots copies
+	 * into a texture before the commit is applied. */
+	unsigned int shm_commits;
+	uint64_t shm_bytes;
+	/* Time spent processing those commits, from the request being
+	 * dispatched to Cage seeing the new surface state. */
+	unsigned int shm_timed_commits;
+	int64_t shm_time_total; // nsec
+	int64_t shm_time_max; // nsec
+
+	struct wl_listener destroy;
+};
+
+bool client_stats_init(struct cg_server *server);
+void client_stats_fini(struct cg_server *server);
+void client_record_commit(struct cg_server *server, struct wlr_surface *surface);
+void client_log_statistics(struct cg_client *client);
+
+#endif
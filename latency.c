@@ -0,0 +1,128 @@
+/*
+ * Cage: A Wayland kiosk.
+ *
+ * Copyright (C) 2018-2020 Jente Hidskes
+ *
+ * See the LICENSE file accompanying this file.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+
+#include "latency.h"
+#include "util.h"
+
+const int cg_latency_bucket_limits[CG_LATENCY_BUCKETS - 1] = {4, 8, 16, 33, 50, 100};
+
+void
+latency_reset(struct cg_latency *latency)
+{
+	latency->has_pending = false;
+	latency->has_in_flight = false;
+}
+
+void
+latency_record_commit(struct cg_latency *latency, const struct timespec *when)
+{
+	if (latency->has_pending) {
+		latency->dropped++;
+	}
+
+	latency->has_pending = true;
+	latency->pending = *when;
+}
+
+void
+latency_record_output_commit(struct cg_latency *latency, struct wlr_output *output)
+{
+	if (!latency->has_pending) {
+		return;
+	}
+
+	/* The present event of an output commit carries the sequence
+	   number the output had after that commit. */
+	latency->has_pending = false;
+	latency->has_in_flight = true;
+	latency->in_flight = latency->pending;
+	latency->in_flight_output = output;
+	latency->in_flight_seq = output->commit_seq;
+}
+
+void
+latency_record_present(struct cg_latency *latency, struct wlr_output_event_present *event)
+{
+	if (!latency->has_in_flight || latency->in_flight_output != event->output ||
+	    latency->in_flight_seq != event->commit_seq) {
+		return;
+	}
+	latency->has_in_flight = false;
+
+	if (!event->presented || !event->when) {
+		latency->dropped++;
+		return;
+	}
+
+	/* This assumes the backend presents with CLOCK_MONOTONIC, as
+	   the DRM backend does. */
+	int64_t time = timespec_diff_nsec(event->when, &latency->in_flight);
+	if (time < 0) {
+		return;
+	}
+
+	latency->presented++;
+	if (time > latency->max) {
+		latency->max = time;
+	}
+
+	int bucket = 0;
+	while (bucket < CG_LATENCY_BUCKETS - 1 && time >= (int64_t) cg_latency_bucket_limits[bucket] * 1000000) {
+		bucket++;
+	}
+	latency->histogram[bucket]++;
+
+	/* A commit right after a frame was rendered waits for the next
+	   frame, which is then shown a refresh cycle later. Anything
+	   beyond those two cycles is a missed vblank. */
+	if (event->refresh > 0 && time >= 2 * (int64_t) event->refresh) {
+		latency->missed_vblanks += time / event->refresh - 1;
+	}
+}
+
+/* Drops the commit in flight on an output that is going away. */
+void
+latency_forget_output(struct cg_latency *latency, struct wlr_output *output)
+{
+	if (latency->has_in_flight && latency->in_flight_output == output) {
+		latency->has_in_flight = false;
+		latency->in_flight_output = NULL;
+		latency->dropped++;
+	}
+}
+
+void
+latency_log_statistics(struct cg_latency *latency, const char *name)
+{
+	if (latency->presented == 0 && latency->dropped == 0) {
+		return;
+	}
+
+	char histogram[256];
+	int n = 0;
+	for (int i = 0; i < CG_LATENCY_BUCKETS && n < (int) sizeof(histogram); i++) {
+		if (i < CG_LATENCY_BUCKETS - 1) {
+			n += snprintf(histogram + n, sizeof(histogram) - n, "%s<%d ms: %u", i ? ", " : "",
+				      cg_latency_bucket_limits[i], latency->histogram[i]);
+		} else {
+			n += snprintf(histogram + n, sizeof(histogram) - n, ", >=%d ms: %u",
+				      cg_latency_bucket_limits[i - 1], latency->histogram[i]);
+		}
+	}
+
+	wlr_log(WLR_INFO, "%s: %u presented, %u dropped, %u missed vblanks, max latency %.1f ms", name,
+		latency->presented, latency->dropped, latency->missed_vblanks, latency->max / 1e6);
+	wlr_log(WLR_INFO, "%s: latency %s", name, histogram);
+}
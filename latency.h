@@ -0,0 +1,47 @@
+#ifndef CG_LATENCY_H
+#define CG_LATENCY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <wlr/types/wlr_output.h>
+
+/* Upper bounds of the latency histogram's buckets; the last bucket
+ * holds everything above. */
+#define CG_LATENCY_BUCKETS 7
+extern const int cg_latency_bucket_limits[CG_LATENCY_BUCKETS - 1]; // msec
+
+/* Tracks how long new content of a client takes to reach the screen,
+ * from the commit that carries it to the presentation of the first
+ * output frame that contains it. */
+struct cg_latency {
+	/* Commit that hasn't been picked up by an output commit yet. */
+	bool has_pending;
+	struct timespec pending;
+	/* Commit that is part of an output commit that hasn't been
+	 * presented yet. */
+	bool has_in_flight;
+	struct timespec in_flight;
+	/* Sequence numbers are per output, so only the output that
+	 * picked up the commit can present it. */
+	struct wlr_output *in_flight_output;
+	uint32_t in_flight_seq;
+
+	unsigned int histogram[CG_LATENCY_BUCKETS];
+	unsigned int presented;
+	/* Commits that were replaced before reaching an output commit,
+	 * or whose output commit was discarded. */
+	unsigned int dropped;
+	/* Refresh cycles by which presentation was late. */
+	unsigned int missed_vblanks;
+	int64_t max; // nsec
+};
+
+void latency_reset(struct cg_latency *latency);
+void latency_record_commit(struct cg_latency *latency, const struct timespec *when);
+void latency_record_output_commit(struct cg_latency *latency, struct wlr_output *output);
+void latency_record_present(struct cg_latency *latency, struct wlr_output_event_present *event);
+void latency_forget_output(struct cg_latency *latency, struct wlr_output *output);
+void latency_log_statistics(struct cg_latency *latency, const char *name);
+
+#endif
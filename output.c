@@ -11,7 +11,9 @@
 
 #include "config.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 #include <wayland-server-core.h>
 #include <wlr/backend.h>
@@ -21,6 +23,7 @@
 #include <wlr/backend/x11.h>
 #endif
 #include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_data_device.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_output.h>
@@ -41,6 +44,16 @@
 #include "xwayland.h"
 #endif
 
+/* How often the content's cadence is compared to the refresh rate. */
+#define REFRESH_MATCH_INTERVAL 500 // ms
+/* Number of consecutive intervals that must call for the same mode
+ * before we switch to it. */
+#define REFRESH_MATCH_STABLE_TICKS 4
+/* Minimum time between two consecutive mode switches. */
+#define REFRESH_MATCH_MIN_DWELL 5000 // ms
+/* Tolerance when matching refresh rates, in per mille. */
+#define REFRESH_MATCH_TOLERANCE 10
+
 static void output_for_each_surface(struct cg_output *output, cg_surface_iterator_func_t iterator, void *user_data);
 
 struct surface_iterator_data {
@@ -143,7 +156,8 @@ output_drag_icons_for_each_surface(struct cg_output *output, struct wl_list *dra
 {
 	struct cg_drag_icon *drag_icon;
 	wl_list_for_each (drag_icon, drag_icons, link) {
-		if (drag_icon->wlr_drag_icon->mapped) {
+		/* Drag icons on the cursor plane are drawn by wlroots. */
+		if (drag_icon->wlr_drag_icon->mapped && !drag_icon->on_cursor) {
 			double ox = drag_icon->lx;
 			double oy = drag_icon->ly;
 			wlr_output_layout_output_coords(output->server->output_layout, output->wlr_output, &ox, &oy);
@@ -153,6 +167,40 @@ output_drag_icons_for_each_surface(struct cg_output *output, struct wl_list *dra
 	}
 }
 
+#if CAGE_HAS_XWAYLAND
+void
+output_xwayland_unmanaged_for_each_surface(struct cg_output *output, cg_surface_iterator_func_t iterator,
+					   void *user_data)
+{
+	struct cg_xwayland_unmanaged *unmanaged;
+	wl_list_for_each_reverse (unmanaged, &output->server->xwayland_unmanaged, link) {
+		double ox = unmanaged->lx;
+		double oy = unmanaged->ly;
+		wlr_output_layout_output_coords(output->server->output_layout, output->wlr_output, &ox, &oy);
+		output_surface_for_each_surface(output, unmanaged->xwayland_surface->surface, ox, oy, iterator,
+						user_data);
+	}
+}
+
+static bool
+output_has_xwayland_unmanaged(struct cg_output *output)
+{
+	struct cg_xwayland_unmanaged *unmanaged;
+	wl_list_for_each (unmanaged, &output->server->xwayland_unmanaged, link) {
+		struct wlr_box box = {
+			.x = unmanaged->lx,
+			.y = unmanaged->ly,
+			.width = unmanaged->xwayland_surface->width,
+			.height = unmanaged->xwayland_surface->height,
+		};
+		if (wlr_output_layout_intersects(output->server->output_layout, output->wlr_output, &box)) {
+			return true;
+		}
+	}
+	return false;
+}
+#endif
+
 static void
 output_for_each_surface(struct cg_output *output, cg_surface_iterator_func_t iterator, void *user_data)
 {
@@ -161,6 +209,10 @@ output_for_each_surface(struct cg_output *output, cg_surface_iterator_func_t ite
 		output_view_for_each_surface(output, view, iterator, user_data);
 	}
 
+#if CAGE_HAS_XWAYLAND
+	output_xwayland_unmanaged_for_each_surface(output, iterator, user_data);
+#endif
+
 	output_drag_icons_for_each_surface(output, &output->server->seat->drag_icons, iterator, user_data);
 }
 
@@ -196,11 +248,17 @@ scan_out_primary_view(struct cg_output *output)
 
 	struct cg_drag_icon *drag_icon;
 	wl_list_for_each (drag_icon, &server->seat->drag_icons, link) {
-		if (drag_icon->wlr_drag_icon->mapped) {
+		if (drag_icon->wlr_drag_icon->mapped && !drag_icon->on_cursor) {
 			return false;
 		}
 	}
 
+#if CAGE_HAS_XWAYLAND
+	if (output_has_xwayland_unmanaged(output)) {
+		return false;
+	}
+#endif
+
 	struct cg_view *view = seat_get_focus(server->seat);
 	if (!view || !view->wlr_surface) {
 		return false;
@@ -308,6 +366,84 @@ output_damage_surface(struct cg_output *output, struct wlr_surface *surface, dou
 	output_surface_for_each_surface(output, surface, ox, oy, damage_surface_iterator, &whole);
 }
 
+/* Rate at which frame callbacks are sent in benchmark mode when the
+ * output doesn't have a refresh rate. */
+#define BENCHMARK_DEFAULT_REFRESH 60000 // mHz
+
+static uint64_t
+region_area(pixman_region32_t *region)
+{
+	uint64_t area = 0;
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+	for (int i = 0; i < nrects; i++) {
+		area += (uint64_t) (rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+	}
+	return area;
+}
+
+/* In benchmark mode, this stands in for the output's frame event.
+ * It does everything a frame would, except for rendering and
+ * committing: the accumulated damage is consumed and clients get
+ * their frame callbacks. */
+static int
+handle_benchmark_timer(void *data)
+{
+	struct cg_output *output = data;
+	struct wlr_output *wlr_output = output->wlr_output;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	if (wlr_output->enabled) {
+		output->benchmark_frames++;
+		output->benchmark_damage += region_area(&output->damage->current);
+		pixman_region32_clear(&output->damage->current);
+
+		struct send_frame_done_data frame_data = {
+			.when = now,
+		};
+		send_frame_done(output, &frame_data);
+	}
+
+	/* Follow an ideal timeline, so that rounding the timer to
+	   milliseconds doesn't change the rate on average. */
+	int refresh = wlr_output->refresh > 0 ? wlr_output->refresh : BENCHMARK_DEFAULT_REFRESH;
+	int64_t period = 1000000000000 / refresh; // nsec
+	output->benchmark_next.tv_nsec += period;
+	while (output->benchmark_next.tv_nsec >= 1000000000) {
+		output->benchmark_next.tv_sec++;
+		output->benchmark_next.tv_nsec -= 1000000000;
+	}
+
+	int64_t delay = timespec_diff_nsec(&output->benchmark_next, &now);
+	if (delay < 0) {
+		/* We fell behind; skip the frames we missed. */
+		output->benchmark_next = now;
+		delay = period;
+	}
+	int delay_ms = (delay + 500000) / 1000000;
+	wl_event_source_timer_update(output->benchmark_timer, delay_ms > 0 ? delay_ms : 1);
+	return 0;
+}
+
+static void
+record_render_time(struct cg_output *output, const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t time = timespec_diff_nsec(&now, start);
+
+	event_stats_record(&output->render_stats, start);
+
+	int refresh = output->wlr_output->refresh;
+	if (refresh > 0 && time > 1000000000000LL / refresh) {
+		output->render_overruns++;
+		wlr_log(WLR_DEBUG, "Output %s took %.2f ms to render, longer than a refresh cycle",
+			output->wlr_output->name, time / 1e6);
+	}
+}
+
 static void
 handle_output_damage_frame(struct wl_listener *listener, void *data)
 {
@@ -318,6 +454,11 @@ handle_output_damage_frame(struct wl_listener *listener, void *data)
 		return;
 	}
 
+	/* See handle_benchmark_timer. */
+	if (output->server->benchmark) {
+		return;
+	}
+
 	/* Check if we can scan-out the primary view. */
 	static bool last_scanned_out = false;
 	bool scanned_out = scan_out_primary_view(output);
@@ -331,6 +472,8 @@ handle_output_damage_frame(struct wl_listener *listener, void *data)
 	last_scanned_out = scanned_out;
 
 	if (scanned_out) {
+		/* Damage isn't tracked into the shadow while scanning out. */
+		output_shadow_invalidate(output);
 		goto frame_done;
 	}
 
@@ -347,7 +490,10 @@ handle_output_damage_frame(struct wl_listener *listener, void *data)
 		goto damage_finish;
 	}
 
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	output_render(output, &damage);
+	record_render_time(output, &start);
 
 damage_finish:
 	pixman_region32_fini(&damage);
@@ -367,6 +513,15 @@ handle_output_commit(struct wl_listener *listener, void *data)
 		return;
 	}
 
+	if (event->committed & WLR_OUTPUT_STATE_BUFFER) {
+		struct cg_view *view;
+		wl_list_for_each (view, &output->server->views, link) {
+			if (view_is_on_output(view, output->wlr_output)) {
+				latency_record_output_commit(&view->latency, output->wlr_output);
+			}
+		}
+	}
+
 	if (event->committed & WLR_OUTPUT_STATE_TRANSFORM) {
 		struct cg_view *view;
 		wl_list_for_each (view, &output->server->views, link) {
@@ -375,28 +530,182 @@ handle_output_commit(struct wl_listener *listener, void *data)
 	}
 }
 
+static void
+handle_output_present(struct wl_listener *listener, void *data)
+{
+	struct cg_output *output = wl_container_of(listener, output, present);
+	struct wlr_output_event_present *event = data;
+
+	struct cg_view *view;
+	wl_list_for_each (view, &output->server->views, link) {
+		latency_record_present(&view->latency, event);
+	}
+}
+
 static void
 handle_output_mode(struct wl_listener *listener, void *data)
 {
 	struct cg_output *output = wl_container_of(listener, output, mode);
+	struct wlr_output *wlr_output = output->wlr_output;
 
-	if (!output->wlr_output->enabled) {
+	if (!wlr_output->enabled) {
 		return;
 	}
 
+	/* A change of refresh rate alone doesn't affect the layout. */
+	if (wlr_output->width == output->width && wlr_output->height == output->height) {
+		return;
+	}
+	output->width = wlr_output->width;
+	output->height = wlr_output->height;
+
 	struct cg_view *view;
 	wl_list_for_each (view, &output->server->views, link) {
 		view_position(view);
 	}
 }
 
+static bool
+refresh_is_multiple_of(int refresh, int rate)
+{
+	int factor = (refresh + rate / 2) / rate;
+	if (factor < 1) {
+		return false;
+	}
+	return abs(refresh - factor * rate) * 1000 <= refresh * REFRESH_MATCH_TOLERANCE;
+}
+
+/* Finds the mode with the same resolution as the base mode whose
+ * refresh rate is an integer multiple of the content rate. If there
+ * are several, the one closest to the base mode's refresh rate wins. */
+static struct wlr_output_mode *
+output_find_refresh_mode(struct cg_output *output, int rate)
+{
+	struct wlr_output_mode *base = output->base_mode;
+
+	if (base->refresh > 0 && refresh_is_multiple_of(base->refresh, rate)) {
+		return base;
+	}
+
+	struct wlr_output_mode *best = NULL;
+	struct wlr_output_mode *mode;
+	wl_list_for_each (mode, &output->wlr_output->modes, link) {
+		if (mode->width != base->width || mode->height != base->height || mode->refresh <= 0) {
+			continue;
+		}
+		if (mode == output->refresh_failed || !refresh_is_multiple_of(mode->refresh, rate)) {
+			continue;
+		}
+		if (!best || abs(mode->refresh - base->refresh) < abs(best->refresh - base->refresh)) {
+			best = mode;
+		}
+	}
+
+	return best ? best : base;
+}
+
+static void
+output_match_content_refresh(struct cg_output *output, struct cg_view *view, const struct timespec *now)
+{
+	struct wlr_output *wlr_output = output->wlr_output;
+
+	if (!wlr_output->enabled || !output->base_mode) {
+		return;
+	}
+
+	int rate = view ? cadence_get_rate(&view->cadence, now) : 0;
+	if (rate != output->content_rate) {
+		wlr_log(WLR_DEBUG, "Output %s: content cadence estimated at %d.%03d Hz", wlr_output->name, rate / 1000,
+			rate % 1000);
+		output->content_rate = rate;
+	}
+
+	/* Without a view we go back to the base mode, but as long as
+	   the view's cadence is unknown (e.g. because the content is
+	   paused) we stay in whatever mode we are in. */
+	struct wlr_output_mode *target = output->base_mode;
+	if (view) {
+		if (rate == 0) {
+			output->refresh_stable_ticks = 0;
+			return;
+		}
+		target = output_find_refresh_mode(output, rate);
+	}
+
+	if (target != output->refresh_candidate) {
+		output->refresh_candidate = target;
+		output->refresh_stable_ticks = 0;
+	}
+
+	if (target == wlr_output->current_mode) {
+		return;
+	}
+
+	if (++output->refresh_stable_ticks < REFRESH_MATCH_STABLE_TICKS ||
+	    timespec_diff_nsec(now, &output->last_mode_switch) / 1000000 < REFRESH_MATCH_MIN_DWELL) {
+		return;
+	}
+	output->refresh_stable_ticks = 0;
+
+	wlr_log(WLR_INFO, "Output %s: switching to %dx%d@%d.%03d Hz for content at %d.%03d Hz", wlr_output->name,
+		target->width, target->height, target->refresh / 1000, target->refresh % 1000, rate / 1000,
+		rate % 1000);
+
+	wlr_output_set_mode(wlr_output, target);
+	if (!wlr_output_commit(wlr_output)) {
+		wlr_log(WLR_ERROR, "Output %s: cannot switch to %d.%03d Hz, not trying this mode again",
+			wlr_output->name, target->refresh / 1000, target->refresh % 1000);
+		wlr_output_rollback(wlr_output);
+		output->refresh_failed = target;
+		output->refresh_candidate = NULL;
+		return;
+	}
+
+	output->last_mode_switch = *now;
+	output->mode_switches++;
+}
+
+int
+handle_refresh_match_timer(void *data)
+{
+	struct cg_server *server = data;
+	struct cg_view *view = seat_get_focus(server->seat);
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	struct cg_output *output;
+	wl_list_for_each (output, &server->outputs, link) {
+		output_match_content_refresh(output, view, &now);
+	}
+
+	wl_event_source_timer_update(server->refresh_match_timer, REFRESH_MATCH_INTERVAL);
+	return 0;
+}
+
 static void
 output_destroy(struct cg_output *output)
 {
 	struct cg_server *server = output->server;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	struct cg_view *view;
+	wl_list_for_each (view, &server->views, link) {
+		if (view->cache.output == output) {
+			view_cache_invalidate(view);
+		}
+		latency_forget_output(&view->latency, output->wlr_output);
+	}
+
+	if (output->benchmark_timer) {
+		wl_event_source_remove(output->benchmark_timer);
+	}
+	output_shadow_invalidate(output);
 
 	wl_list_remove(&output->destroy.link);
 	wl_list_remove(&output->commit.link);
+	wl_list_remove(&output->present.link);
 	wl_list_remove(&output->mode.link);
 	wl_list_remove(&output->damage_frame.link);
 	wl_list_remove(&output->damage_destroy.link);
@@ -419,6 +728,8 @@ output_destroy(struct cg_output *output)
 			}
 		}
 	}
+
+	event_stats_record(&server->output_destroy_stats, &start);
 }
 
 static void
@@ -441,6 +752,8 @@ handle_new_output(struct wl_listener *listener, void *data)
 {
 	struct cg_server *server = wl_container_of(listener, server, new_output);
 	struct wlr_output *wlr_output = data;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	struct cg_output *output = calloc(1, sizeof(struct cg_output));
 	if (!output) {
@@ -455,6 +768,8 @@ handle_new_output(struct wl_listener *listener, void *data)
 
 	output->commit.notify = handle_output_commit;
 	wl_signal_add(&wlr_output->events.commit, &output->commit);
+	output->present.notify = handle_output_present;
+	wl_signal_add(&wlr_output->events.present, &output->present);
 	output->mode.notify = handle_output_mode;
 	wl_signal_add(&wlr_output->events.mode, &output->mode);
 	output->destroy.notify = handle_output_destroy;
@@ -464,10 +779,22 @@ handle_new_output(struct wl_listener *listener, void *data)
 	output->damage_destroy.notify = handle_output_damage_destroy;
 	wl_signal_add(&output->damage->events.destroy, &output->damage_destroy);
 
+	if (server->benchmark) {
+		struct wl_event_loop *event_loop = wl_display_get_event_loop(server->wl_display);
+		output->benchmark_timer = wl_event_loop_add_timer(event_loop, handle_benchmark_timer, output);
+		if (!output->benchmark_timer) {
+			wlr_log(WLR_ERROR, "Unable to create the benchmark timer for output %s", wlr_output->name);
+		} else {
+			clock_gettime(CLOCK_MONOTONIC, &output->benchmark_next);
+			wl_event_source_timer_update(output->benchmark_timer, 1);
+		}
+	}
+
 	struct wlr_output_mode *preferred_mode = wlr_output_preferred_mode(wlr_output);
 	if (preferred_mode) {
 		wlr_output_set_mode(wlr_output, preferred_mode);
 	}
+	output->base_mode = preferred_mode;
 	wlr_output_set_transform(wlr_output, output->server->output_transform);
 
 	if (server->output_mode == CAGE_MULTI_OUTPUT_MODE_LAST) {
@@ -488,6 +815,8 @@ handle_new_output(struct wl_listener *listener, void *data)
 	wl_list_for_each (view, &output->server->views, link) {
 		view_position(view);
 	}
+
+	event_stats_record(&server->new_output_stats, &start);
 }
 
 void
@@ -508,3 +837,28 @@ output_set_window_title(struct cg_output *output, const char *title)
 #endif
 	}
 }
+
+void
+output_log_statistics(struct cg_output *output)
+{
+	struct wlr_output *wlr_output = output->wlr_output;
+
+	wlr_log(WLR_INFO, "Output %s: %dx%d@%d.%03d Hz, content at %d.%03d Hz, %u mode switches", wlr_output->name,
+		wlr_output->width, wlr_output->height, wlr_output->refresh / 1000, wlr_output->refresh % 1000,
+		output->content_rate / 1000, output->content_rate % 1000, output->mode_switches);
+
+	char name[64];
+	snprintf(name, sizeof(name), "Output %s render", wlr_output->name);
+	event_stats_log(&output->render_stats, name);
+	if (output->render_overruns > 0) {
+		wlr_log(WLR_INFO, "Output %s: %u frames took longer than a refresh cycle to render", wlr_output->name,
+			output->render_overruns);
+	}
+
+	if (output->server->benchmark && output->benchmark_frames > 0) {
+		uint64_t area = (uint64_t) wlr_output->width * wlr_output->height;
+		wlr_log(WLR_INFO, "Output %s: %u benchmark frames, %.1f%% damaged on average", wlr_output->name,
+			output->benchmark_frames,
+			area ? 100.0 * output->benchmark_damage / output->benchmark_frames / area : 0.0);
+	}
+}
@@ -1,11 +1,16 @@
 #ifndef CG_OUTPUT_H
 #define CG_OUTPUT_H
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
 #include <wayland-server-core.h>
+#include <wlr/render/wlr_texture.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_output_damage.h>
 
 #include "server.h"
+#include "util.h"
 #include "view.h"
 
 struct cg_output {
@@ -13,7 +18,43 @@ struct cg_output {
 	struct wlr_output *wlr_output;
 	struct wlr_output_damage *damage;
 
+	/* Last seen resolution, to tell mode changes that affect the
+	 * layout apart from refresh rate changes. */
+	int width, height;
+
+	/* The mode to fall back to when the content's frame rate does
+	 * not call for a different refresh rate. NULL if the backend
+	 * doesn't support modes. */
+	struct wlr_output_mode *base_mode;
+	struct wlr_output_mode *refresh_candidate;
+	struct wlr_output_mode *refresh_failed;
+	int refresh_stable_ticks;
+	int content_rate; // mHz
+	struct timespec last_mode_switch;
+	unsigned int mode_switches;
+
+	/* Paces frame callbacks in benchmark mode. */
+	struct wl_event_source *benchmark_timer;
+	struct timespec benchmark_next;
+	unsigned int benchmark_frames;
+	uint64_t benchmark_damage; // pixels
+
+	/* Time spent compositing and committing frames on the main
+	 * thread. Frames that take longer than a refresh cycle hold up
+	 * the other outputs. */
+	struct cg_event_stats render_stats;
+	unsigned int render_overruns;
+
+	/* Copy of the last composited frame without software cursors,
+	 * for renderers that can't tell the age of their buffers. */
+	struct wlr_texture *shadow_texture;
+	uint8_t *shadow_pixels;
+	uint32_t shadow_format;
+	int shadow_width, shadow_height;
+	bool shadow_failed;
+
 	struct wl_listener commit;
+	struct wl_listener present;
 	struct wl_listener mode;
 	struct wl_listener destroy;
 	struct wl_listener damage_frame;
@@ -26,13 +67,19 @@ typedef void (*cg_surface_iterator_func_t)(struct cg_output *output, struct wlr_
 					   void *user_data);
 
 void handle_new_output(struct wl_listener *listener, void *data);
+int handle_refresh_match_timer(void *data);
 void output_surface_for_each_surface(struct cg_output *output, struct wlr_surface *surface, double ox, double oy,
 				     cg_surface_iterator_func_t iterator, void *user_data);
 void output_view_for_each_popup_surface(struct cg_output *output, struct cg_view *view,
 					cg_surface_iterator_func_t iterator, void *user_data);
 void output_drag_icons_for_each_surface(struct cg_output *output, struct wl_list *drag_icons,
 					cg_surface_iterator_func_t iterator, void *user_data);
+#if CAGE_HAS_XWAYLAND
+void output_xwayland_unmanaged_for_each_surface(struct cg_output *output, cg_surface_iterator_func_t iterator,
+						void *user_data);
+#endif
 void output_damage_surface(struct cg_output *output, struct wlr_surface *surface, double lx, double ly, bool whole);
 void output_set_window_title(struct cg_output *output, const char *title);
+void output_log_statistics(struct cg_output *output);
 
 #endif
@@ -7,6 +7,12 @@
  * See the LICENSE file accompanying this file.
  */
 
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <wayland-server-core.h>
 #include <wlr/backend.h>
 #include <wlr/render/wlr_renderer.h>
@@ -44,6 +50,15 @@ scissor_output(struct wlr_output *output, pixman_box32_t *rect)
 	wlr_renderer_scissor(renderer, &box);
 }
 
+/* Returns whether the output's buffer coordinates match its output
+ * coordinates. Pixels read back from the buffer, as the view cache and
+ * the shadow buffer do, can only be reused as is when they do. */
+static bool
+output_is_untransformed(struct cg_output *output)
+{
+	return output->wlr_output->transform == WL_OUTPUT_TRANSFORM_NORMAL;
+}
+
 struct render_data {
 	pixman_region32_t *damage;
 };
@@ -95,6 +110,17 @@ render_surface_iterator(struct cg_output *output, struct wlr_surface *surface, s
 	render_texture(wlr_output, output_damage, texture, box, matrix);
 }
 
+#if CAGE_HAS_XWAYLAND
+static void
+render_xwayland_unmanaged(struct cg_output *output, pixman_region32_t *damage)
+{
+	struct render_data data = {
+		.damage = damage,
+	};
+	output_xwayland_unmanaged_for_each_surface(output, render_surface_iterator, &data);
+}
+#endif
+
 static void
 render_drag_icons(struct cg_output *output, pixman_region32_t *damage, struct wl_list *drag_icons)
 {
@@ -104,6 +130,34 @@ render_drag_icons(struct cg_output *output, pixman_region32_t *damage, struct wl
 	output_drag_icons_for_each_surface(output, drag_icons, render_surface_iterator, &data);
 }
 
+struct render_range_data {
+	struct render_data render;
+	/* Only surfaces with an index in [from, to) are rendered. */
+	size_t index, from, to;
+};
+
+static void
+render_range_surface_iterator(struct cg_output *output, struct wlr_surface *surface, struct wlr_box *box,
+			      void *user_data)
+{
+	struct render_range_data *data = user_data;
+	size_t index = data->index++;
+
+	if (index < data->from || index >= data->to) {
+		return;
+	}
+
+	render_surface_iterator(output, surface, box, &data->render);
+}
+
+static void
+view_output_coords(struct cg_view *view, struct cg_output *output, double *ox, double *oy)
+{
+	*ox = view->lx;
+	*oy = view->ly;
+	wlr_output_layout_output_coords(output->server->output_layout, output->wlr_output, ox, oy);
+}
+
 /**
  * Render all toplevels without descending into popups.
  */
@@ -113,12 +167,218 @@ render_view_toplevels(struct cg_view *view, struct cg_output *output, pixman_reg
 	struct render_data data = {
 		.damage = damage,
 	};
-	double ox = view->lx;
-	double oy = view->ly;
-	wlr_output_layout_output_coords(output->server->output_layout, output->wlr_output, &ox, &oy);
+	double ox, oy;
+	view_output_coords(view, output, &ox, &oy);
 	output_surface_for_each_surface(output, view->wlr_surface, ox, oy, render_surface_iterator, &data);
 }
 
+/* Upper bound on the memory used by all view caches together. */
+#define VIEW_CACHE_BUDGET (64 * 1024 * 1024)
+/* Minimum time between two builds of a view's cache, so that a view
+ * whose static surfaces keep changing falls back to regular
+ * rendering instead of paying for a read back every frame. */
+#define VIEW_CACHE_MIN_INTERVAL 1000 // ms
+
+struct view_cache_data {
+	struct cg_view *view;
+	struct timespec now;
+	bool hot;
+	/* The static surfaces below the view's first hot surface. */
+	size_t n_surfaces;
+	uint32_t key;
+	struct wlr_box box;
+	bool rebuild;
+};
+
+static uint32_t
+hash_step(uint32_t hash, uint32_t value)
+{
+	/* FNV-1a, one 32-bit word at a time. */
+	return (hash ^ value) * 16777619u;
+}
+
+static void
+view_cache_surface_iterator(struct cg_output *output, struct wlr_surface *surface, struct wlr_box *_box,
+			    void *user_data)
+{
+	struct view_cache_data *data = user_data;
+
+	if (data->hot || view_surface_is_hot(data->view, surface, &data->now)) {
+		data->hot = true;
+		return;
+	}
+
+	struct wlr_box box = *_box;
+	scale_box(&box, output->wlr_output->scale);
+
+	if (data->n_surfaces == 0) {
+		data->box = box;
+	} else {
+		int x1 = box.x < data->box.x ? box.x : data->box.x;
+		int y1 = box.y < data->box.y ? box.y : data->box.y;
+		int x2 = box.x + box.width > data->box.x + data->box.width ? box.x + box.width
+									      : data->box.x + data->box.width;
+		int y2 = box.y + box.height > data->box.y + data->box.height ? box.y + box.height
+										: data->box.y + data->box.height;
+		data->box = (struct wlr_box){.x = x1, .y = y1, .width = x2 - x1, .height = y2 - y1};
+	}
+
+	data->key = hash_step(data->key, (uint32_t) (uintptr_t) surface);
+	data->key = hash_step(data->key, (uint32_t) box.x);
+	data->key = hash_step(data->key, (uint32_t) box.y);
+	data->key = hash_step(data->key, (uint32_t) box.width);
+	data->key = hash_step(data->key, (uint32_t) box.height);
+	data->n_surfaces++;
+}
+
+/* Decides whether the view can be drawn from its cache this frame,
+ * either as is or after rebuilding it. In the latter case the
+ * damage is extended to cover the whole cache, because the cache is
+ * read back from the frame being rendered. */
+static bool
+view_cache_prepare(struct cg_view *view, struct cg_output *output, pixman_region32_t *damage,
+		   struct view_cache_data *data)
+{
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct cg_view_cache *cache = &view->cache;
+
+	if (!output_is_untransformed(output)) {
+		return false;
+	}
+
+	if (cache->texture && cache->output != output) {
+		return false;
+	}
+
+	*data = (struct view_cache_data){
+		.view = view,
+		.key = 2166136261u,
+	};
+	clock_gettime(CLOCK_MONOTONIC, &data->now);
+
+	double ox, oy;
+	view_output_coords(view, output, &ox, &oy);
+	output_surface_for_each_surface(output, view->wlr_surface, ox, oy, view_cache_surface_iterator, data);
+
+	struct wlr_box output_box = {
+		.width = wlr_output->width,
+		.height = wlr_output->height,
+	};
+	struct wlr_box box;
+	if (data->n_surfaces == 0 || !wlr_box_intersection(&box, &data->box, &output_box)) {
+		view_cache_invalidate(view);
+		return false;
+	}
+	data->box = box;
+
+	if (cache->texture && cache->n_surfaces == data->n_surfaces && cache->key == data->key) {
+		return true;
+	}
+
+	view_cache_invalidate(view);
+
+	if (timespec_diff_nsec(&data->now, &cache->last_build) / 1000000 < VIEW_CACHE_MIN_INTERVAL) {
+		return false;
+	}
+
+	size_t size = (size_t) box.width * box.height * 4;
+	if (output->server->view_cache_size + size > VIEW_CACHE_BUDGET) {
+		wlr_log(WLR_DEBUG, "Not caching view: %zu KiB would exceed the cache budget", size / 1024);
+		return false;
+	}
+
+	pixman_region32_union_rect(damage, damage, box.x, box.y, box.width, box.height);
+	data->rebuild = true;
+	return true;
+}
+
+/* Reads back the cache's box from the frame being rendered, which at
+ * this point contains only the background and the static surfaces. */
+static void
+view_cache_build(struct cg_view *view, struct cg_output *output, struct view_cache_data *data)
+{
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(wlr_output->backend);
+	struct cg_view_cache *cache = &view->cache;
+	struct wlr_box *box = &data->box;
+
+	cache->last_build = data->now;
+
+	uint32_t format = wlr_renderer_preferred_read_format(renderer);
+	uint32_t stride = box->width * 4;
+	size_t size = (size_t) stride * box->height;
+	uint8_t *pixels = malloc(size);
+	if (!pixels) {
+		wlr_log(WLR_ERROR, "Cannot allocate %zu KiB for view cache", size / 1024);
+		return;
+	}
+
+	uint32_t flags = 0;
+	if (!wlr_renderer_read_pixels(renderer, format, &flags, stride, box->width, box->height, box->x, box->y, 0, 0,
+				      pixels)) {
+		wlr_log(WLR_DEBUG, "Cannot read back view for its cache");
+		goto pixels_finish;
+	}
+
+	/* The box was read from the wrong end of the frame. */
+	if (flags & WLR_RENDERER_READ_PIXELS_Y_INVERT) {
+		wlr_log(WLR_DEBUG, "Cannot cache a view on a renderer that reads back upside down");
+		goto pixels_finish;
+	}
+
+	cache->texture = wlr_texture_from_pixels(renderer, format, stride, box->width, box->height, pixels);
+	if (!cache->texture) {
+		wlr_log(WLR_DEBUG, "Cannot create view cache texture");
+		goto pixels_finish;
+	}
+
+	cache->output = output;
+	cache->box = *box;
+	cache->n_surfaces = data->n_surfaces;
+	cache->key = data->key;
+	cache->size = size;
+	output->server->view_cache_size += size;
+
+pixels_finish:
+	free(pixels);
+}
+
+/**
+ * Render all toplevels, drawing the view's static surfaces from its
+ * cache and only its hot surfaces individually.
+ */
+static void
+render_view_toplevels_cached(struct cg_view *view, struct cg_output *output, pixman_region32_t *damage,
+			     struct view_cache_data *cache_data)
+{
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct cg_view_cache *cache = &view->cache;
+
+	double ox, oy;
+	view_output_coords(view, output, &ox, &oy);
+
+	struct render_range_data data = {
+		.render = {.damage = damage},
+	};
+
+	if (cache_data->rebuild) {
+		data.to = cache_data->n_surfaces;
+		output_surface_for_each_surface(output, view->wlr_surface, ox, oy, render_range_surface_iterator,
+						&data);
+		view_cache_build(view, output, cache_data);
+	} else {
+		float matrix[9];
+		wlr_matrix_project_box(matrix, &cache->box, WL_OUTPUT_TRANSFORM_NORMAL, 0.0f,
+				       wlr_output->transform_matrix);
+		render_texture(wlr_output, damage, cache->texture, &cache->box, matrix);
+	}
+
+	data.index = 0;
+	data.from = cache_data->n_surfaces;
+	data.to = SIZE_MAX;
+	output_surface_for_each_surface(output, view->wlr_surface, ox, oy, render_range_surface_iterator, &data);
+}
+
 static void
 render_view_popups(struct cg_view *view, struct cg_output *output, pixman_region32_t *damage)
 {
@@ -128,11 +388,137 @@ render_view_popups(struct cg_view *view, struct cg_output *output, pixman_region
 	output_view_for_each_popup_surface(output, view, render_surface_iterator, &data);
 }
 
+void
+output_shadow_invalidate(struct cg_output *output)
+{
+	if (output->shadow_texture) {
+		wlr_texture_destroy(output->shadow_texture);
+		output->shadow_texture = NULL;
+	}
+	free(output->shadow_pixels);
+	output->shadow_pixels = NULL;
+}
+
+/* Returns whether the output can use a shadow buffer at all. */
+static bool
+output_shadow_is_usable(struct cg_output *output)
+{
+	return output->server->shadow_buffer && !output->shadow_failed && output_is_untransformed(output);
+}
+
+/* Returns whether the output's shadow buffer holds its current
+ * contents, so that a frame only has to composite what was damaged. */
+static bool
+output_shadow_is_valid(struct cg_output *output)
+{
+	struct wlr_output *wlr_output = output->wlr_output;
+
+	if (output->shadow_texture &&
+	    (output->shadow_width != wlr_output->width || output->shadow_height != wlr_output->height)) {
+		output_shadow_invalidate(output);
+	}
+
+	return output->shadow_texture != NULL;
+}
+
+static void
+output_shadow_blit(struct cg_output *output, pixman_region32_t *damage)
+{
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct wlr_box box = {
+		.width = output->shadow_width,
+		.height = output->shadow_height,
+	};
+
+	float matrix[9];
+	wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, 0.0f, wlr_output->transform_matrix);
+	render_texture(wlr_output, damage, output->shadow_texture, &box, matrix);
+}
+
+static void
+output_shadow_fail(struct cg_output *output, const char *reason)
+{
+	wlr_log(WLR_ERROR, "Disabling the shadow buffer of output %s: %s", output->wlr_output->name, reason);
+	output->shadow_failed = true;
+	output_shadow_invalidate(output);
+}
+
+/* Copies the composited, cursor-free contents of the given region of
+ * the frame being rendered into the shadow buffer. Without a shadow
+ * buffer, the whole frame is copied into a new one. */
+static void
+output_shadow_update(struct cg_output *output, pixman_region32_t *region)
+{
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(wlr_output->backend);
+	uint32_t flags = 0;
+
+	if (!output->shadow_texture) {
+		uint32_t width = wlr_output->width;
+		uint32_t height = wlr_output->height;
+		uint32_t stride = width * 4;
+
+		output->shadow_format = wlr_renderer_preferred_read_format(renderer);
+		output->shadow_pixels = malloc((size_t) stride * height);
+		if (!output->shadow_pixels) {
+			output_shadow_fail(output, "cannot allocate memory");
+			return;
+		}
+
+		if (!wlr_renderer_read_pixels(renderer, output->shadow_format, &flags, stride, width, height, 0, 0, 0,
+					      0, output->shadow_pixels)) {
+			output_shadow_fail(output, "cannot read back the frame");
+			return;
+		}
+		if (flags & WLR_RENDERER_READ_PIXELS_Y_INVERT) {
+			output_shadow_fail(output, "the frame is read back upside down");
+			return;
+		}
+
+		output->shadow_texture = wlr_texture_from_pixels(renderer, output->shadow_format, stride, width, height,
+								 output->shadow_pixels);
+		if (!output->shadow_texture) {
+			output_shadow_fail(output, "cannot create a texture");
+			return;
+		}
+		output->shadow_width = width;
+		output->shadow_height = height;
+		return;
+	}
+
+	uint32_t stride = output->shadow_width * 4;
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+	for (int i = 0; i < nrects; i++) {
+		uint32_t x = rects[i].x1;
+		uint32_t y = rects[i].y1;
+		uint32_t width = rects[i].x2 - rects[i].x1;
+		uint32_t height = rects[i].y2 - rects[i].y1;
+
+		if (!wlr_renderer_read_pixels(renderer, output->shadow_format, &flags, stride, width, height, x, y, x,
+					      y, output->shadow_pixels) ||
+		    !wlr_texture_write_pixels(output->shadow_texture, stride, width, height, x, y, x, y,
+					      output->shadow_pixels)) {
+			output_shadow_fail(output, "cannot update the shadow buffer");
+			return;
+		}
+	}
+}
+
 void
 output_render(struct cg_output *output, pixman_region32_t *damage)
 {
 	struct cg_server *server = output->server;
 	struct wlr_output *wlr_output = output->wlr_output;
+	struct cg_view *bottom_view = NULL;
+	struct view_cache_data cache_data;
+	bool shadow = false, shadow_rebuild = false;
+
+	/* With a shadow buffer, only what was damaged since the last
+	   frame is composited; the rest of the frame, which buffer age
+	   would otherwise have to provide, comes from the shadow. */
+	pixman_region32_t render_damage;
+	pixman_region32_init(&render_damage);
 
 	struct wlr_renderer *renderer = wlr_backend_get_renderer(wlr_output->backend);
 	if (!renderer) {
@@ -140,6 +526,21 @@ output_render(struct cg_output *output, pixman_region32_t *damage)
 		return;
 	}
 
+	if (!output_shadow_is_usable(output)) {
+		output_shadow_invalidate(output);
+	} else if (output_shadow_is_valid(output)) {
+		shadow = true;
+		pixman_region32_intersect_rect(&render_damage, &output->damage->current, 0, 0, wlr_output->width,
+					       wlr_output->height);
+	} else {
+		/* Building the shadow takes a complete frame. */
+		shadow_rebuild = true;
+		pixman_region32_union_rect(damage, damage, 0, 0, wlr_output->width, wlr_output->height);
+	}
+	if (!shadow) {
+		pixman_region32_copy(&render_damage, damage);
+	}
+
 	wlr_renderer_begin(renderer, wlr_output->width, wlr_output->height);
 
 	if (!pixman_region32_not_empty(damage)) {
@@ -153,9 +554,27 @@ output_render(struct cg_output *output, pixman_region32_t *damage)
 	}
 #endif
 
+	/* The cache holds the view on top of the background, so only
+	   the bottom-most view can use it. */
+	if (server->view_cache && !wl_list_empty(&server->views)) {
+		struct cg_view *view = wl_container_of(server->views.prev, view, link);
+		if (view_cache_prepare(view, output, &render_damage, &cache_data)) {
+			bottom_view = view;
+		}
+	}
+	pixman_region32_union(damage, damage, &render_damage);
+
+	if (shadow) {
+		pixman_region32_t shadow_damage;
+		pixman_region32_init(&shadow_damage);
+		pixman_region32_subtract(&shadow_damage, damage, &render_damage);
+		output_shadow_blit(output, &shadow_damage);
+		pixman_region32_fini(&shadow_damage);
+	}
+
 	float color[4] = {0.0f, 0.0f, 0.0f, 1.0f};
 	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(damage, &nrects);
+	pixman_box32_t *rects = pixman_region32_rectangles(&render_damage, &nrects);
 	for (int i = 0; i < nrects; i++) {
 		scissor_output(wlr_output, &rects[i]);
 		wlr_renderer_clear(renderer, color);
@@ -164,15 +583,29 @@ output_render(struct cg_output *output, pixman_region32_t *damage)
 	// TODO: render only top view, possibly use focused view for this, see #35.
 	struct cg_view *view;
 	wl_list_for_each_reverse (view, &server->views, link) {
-		render_view_toplevels(view, output, damage);
+		if (view == bottom_view) {
+			render_view_toplevels_cached(view, output, &render_damage, &cache_data);
+		} else {
+			render_view_toplevels(view, output, &render_damage);
+		}
 	}
 
 	struct cg_view *focused_view = seat_get_focus(server->seat);
 	if (focused_view) {
-		render_view_popups(focused_view, output, damage);
+		render_view_popups(focused_view, output, &render_damage);
 	}
 
-	render_drag_icons(output, damage, &server->seat->drag_icons);
+#if CAGE_HAS_XWAYLAND
+	render_xwayland_unmanaged(output, &render_damage);
+#endif
+
+	render_drag_icons(output, &render_damage, &server->seat->drag_icons);
+
+	/* Software cursors are drawn over the shadow on every frame,
+	   so they must not end up in it. */
+	if (shadow || shadow_rebuild) {
+		output_shadow_update(output, &render_damage);
+	}
 
 renderer_end:
 	/* Draw software cursor in case hardware cursors aren't
@@ -190,14 +623,27 @@ renderer_end:
 	enum wl_output_transform transform = wlr_output_transform_invert(wlr_output->transform);
 	wlr_region_transform(&frame_damage, &output->damage->current, transform, output_width, output_height);
 
+	/* Rebuilding a view's cache redraws more than what was damaged.
+	   Caching requires a normal transform, so no need to transform. */
+	if (bottom_view && cache_data.rebuild) {
+		pixman_region32_union_rect(&frame_damage, &frame_damage, cache_data.box.x, cache_data.box.y,
+					   cache_data.box.width, cache_data.box.height);
+	}
+
 #ifdef DEBUG
 	if (server->debug_damage_tracking) {
 		pixman_region32_union_rect(&frame_damage, &frame_damage, 0, 0, output_width, output_height);
 	}
 #endif
 
+	/* Building the shadow redrew the whole frame. */
+	if (shadow_rebuild) {
+		pixman_region32_union_rect(&frame_damage, &frame_damage, 0, 0, output_width, output_height);
+	}
+
 	wlr_output_set_damage(wlr_output, &frame_damage);
 	pixman_region32_fini(&frame_damage);
+	pixman_region32_fini(&render_damage);
 
 	if (!wlr_output_commit(wlr_output)) {
 		wlr_log(WLR_ERROR, "Could not commit output");
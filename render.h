@@ -4,5 +4,6 @@
 #include "output.h"
 
 void output_render(struct cg_output *output, pixman_region32_t *damage);
+void output_shadow_invalidate(struct cg_output *output);
 
 #endif
@@ -6,10 +6,13 @@
  * See the LICENSE file accompanying this file.
  */
 
+#define _POSIX_C_SOURCE 200112L
+
 #include "config.h"
 
 #include <linux/input-event-codes.h>
 #include <stdlib.h>
+#include <time.h>
 #include <wayland-server-core.h>
 #include <wlr/backend.h>
 #include <wlr/backend/multi.h>
@@ -30,12 +33,17 @@
 #include "output.h"
 #include "seat.h"
 #include "server.h"
+#include "util.h"
 #include "view.h"
 #if CAGE_HAS_XWAYLAND
 #include "xwayland.h"
 #endif
 
+/* Largest drag icon, in buffer pixels, that is put on the cursor plane. */
+#define DRAG_ICON_CURSOR_MAX_SIZE 64
+
 static void drag_icon_update_position(struct cg_drag_icon *drag_icon);
+static bool seat_has_drag_icon_on_cursor(struct cg_seat *seat);
 
 /* XDG toplevels may have nested surfaces, such as popup windows for context
  * menus or tooltips. This function tests if any of those are underneath the
@@ -63,13 +71,21 @@ view_at(struct cg_view *view, double lx, double ly, struct wlr_surface **surface
 /* This iterates over all of our surfaces and attempts to find one
  * under the cursor. This relies on server->views being ordered from
  * top-to-bottom. If desktop_view_at returns a view, there is also a
- * surface. There cannot be a surface without a view, either. It's
- * both or nothing. */
+ * surface. The reverse is only true for views: override-redirect X11
+ * windows are above all views, and their surfaces come without one. */
 static struct cg_view *
 desktop_view_at(struct cg_server *server, double lx, double ly, struct wlr_surface **surface, double *sx, double *sy)
 {
 	struct cg_view *view;
 
+	*surface = NULL;
+#if CAGE_HAS_XWAYLAND
+	*surface = xwayland_unmanaged_surface_at(server, lx, ly, sx, sy);
+	if (*surface) {
+		return NULL;
+	}
+#endif
+
 	wl_list_for_each (view, &server->views, link) {
 		if (view_at(view, lx, ly, surface, sx, sy)) {
 			return view;
@@ -95,8 +111,9 @@ press_cursor_button(struct cg_seat *seat, struct wlr_input_device *device, uint3
 		}
 
 		/* Focus that client if the button was pressed and
-		   it has no open dialogs. */
-		if (view && !view_is_transient_for(current, view)) {
+		   it has no open dialogs. Nothing is focused while an
+		   override-redirect window has the keyboard. */
+		if (view && (!current || !view_is_transient_for(current, view))) {
 			seat_set_focus(seat, view);
 		}
 	}
@@ -121,7 +138,7 @@ update_capabilities(struct cg_seat *seat)
 	/* Hide cursor if the seat doesn't have pointer capability. */
 	if ((caps & WL_SEAT_CAPABILITY_POINTER) == 0) {
 		wlr_cursor_set_image(seat->cursor, NULL, 0, 0, 0, 0, 0, 0);
-	} else {
+	} else if (!seat_has_drag_icon_on_cursor(seat)) {
 		wlr_xcursor_manager_set_cursor_image(seat->xcursor_manager, DEFAULT_XCURSOR, seat->cursor);
 	}
 }
@@ -224,16 +241,40 @@ handle_modifier_event(struct wlr_input_device *device, struct cg_seat *seat)
 	wlr_idle_notify_activity(seat->server->idle, seat->seat);
 }
 
+enum cg_keybinding_action {
+	CAGE_KEYBINDING_QUIT,
+	CAGE_KEYBINDING_SWITCH_VT,
+};
+
+struct cg_keybinding {
+	/* All of these must be held for the binding to match. */
+	uint32_t modifiers;
+	/* The binding matches any keysym in [first, last]. */
+	xkb_keysym_t first, last;
+	enum cg_keybinding_action action;
+};
+
+static const struct cg_keybinding keybindings[] = {
+#ifdef DEBUG
+	{WLR_MODIFIER_ALT, XKB_KEY_Escape, XKB_KEY_Escape, CAGE_KEYBINDING_QUIT},
+#endif
+	{WLR_MODIFIER_ALT, XKB_KEY_XF86Switch_VT_1, XKB_KEY_XF86Switch_VT_12, CAGE_KEYBINDING_SWITCH_VT},
+};
+
 static bool
-handle_keybinding(struct cg_server *server, xkb_keysym_t sym)
+keybinding_is_enabled(struct cg_server *server, const struct cg_keybinding *binding)
 {
-#ifdef DEBUG
-	if (sym == XKB_KEY_Escape) {
+	return binding->action != CAGE_KEYBINDING_SWITCH_VT || server->allow_vt_switch;
+}
+
+static void
+run_keybinding(struct cg_server *server, const struct cg_keybinding *binding, xkb_keysym_t sym)
+{
+	switch (binding->action) {
+	case CAGE_KEYBINDING_QUIT:
 		wl_display_terminate(server->wl_display);
-		return true;
-	}
-#endif
-	if (server->allow_vt_switch && sym >= XKB_KEY_XF86Switch_VT_1 && sym <= XKB_KEY_XF86Switch_VT_12) {
+		return;
+	case CAGE_KEYBINDING_SWITCH_VT:
 		if (wlr_backend_is_multi(server->backend)) {
 			struct wlr_session *session = wlr_backend_get_session(server->backend);
 			if (session) {
@@ -241,33 +282,120 @@ handle_keybinding(struct cg_server *server, xkb_keysym_t sym)
 				wlr_session_change_vt(session, vt);
 			}
 		}
-	} else {
-		return false;
+		break;
 	}
 	wlr_idle_notify_activity(server->idle, server->seat->seat);
-	return true;
+}
+
+static bool
+handle_keybinding(struct cg_server *server, struct wlr_keyboard *keyboard, xkb_keycode_t keycode)
+{
+	const xkb_keysym_t *syms;
+	int nsyms = xkb_state_key_get_syms(keyboard->xkb_state, keycode, &syms);
+	uint32_t modifiers = wlr_keyboard_get_modifiers(keyboard);
+
+	for (int i = 0; i < nsyms; i++) {
+		for (size_t j = 0; j < sizeof(keybindings) / sizeof(keybindings[0]); j++) {
+			const struct cg_keybinding *binding = &keybindings[j];
+			if (keybinding_is_enabled(server, binding) && syms[i] >= binding->first &&
+			    syms[i] <= binding->last && (modifiers & binding->modifiers) == binding->modifiers) {
+				run_keybinding(server, binding, syms[i]);
+				return true;
+			}
+		}
+	}
+
+	return false;
 }
 
 static void
-handle_key_event(struct wlr_input_device *device, struct cg_seat *seat, void *data)
+compile_keybindings_for_key(struct xkb_keymap *keymap, xkb_keycode_t keycode, void *data)
 {
+	struct cg_keyboard_group *group = data;
+	struct cg_server *server = group->seat->server;
+	uint32_t *modifiers = &group->keybinding_modifiers[keycode - group->min_keycode];
+
+	xkb_layout_index_t n_layouts = xkb_keymap_num_layouts_for_key(keymap, keycode);
+	for (xkb_layout_index_t layout = 0; layout < n_layouts; layout++) {
+		xkb_level_index_t n_levels = xkb_keymap_num_levels_for_key(keymap, keycode, layout);
+		for (xkb_level_index_t level = 0; level < n_levels; level++) {
+			const xkb_keysym_t *syms;
+			int nsyms = xkb_keymap_key_get_syms_by_level(keymap, keycode, layout, level, &syms);
+			for (int i = 0; i < nsyms; i++) {
+				for (size_t j = 0; j < sizeof(keybindings) / sizeof(keybindings[0]); j++) {
+					const struct cg_keybinding *binding = &keybindings[j];
+					if (keybinding_is_enabled(server, binding) && syms[i] >= binding->first &&
+					    syms[i] <= binding->last) {
+						*modifiers |= binding->modifiers;
+					}
+				}
+			}
+		}
+	}
+}
+
+/* Records, for every keycode of the group's keymap, the modifiers
+ * that a keybinding producing any of its keysyms requires. Keycodes
+ * without an entry can never trigger a keybinding. */
+static void
+keyboard_group_compile_keybindings(struct cg_keyboard_group *group)
+{
+	struct xkb_keymap *keymap = group->wlr_group->keyboard.keymap;
+
+	free(group->keybinding_modifiers);
+	group->keybinding_modifiers = NULL;
+
+	if (!keymap) {
+		return;
+	}
+
+	group->min_keycode = xkb_keymap_min_keycode(keymap);
+	group->max_keycode = xkb_keymap_max_keycode(keymap);
+	group->keybinding_modifiers = calloc(group->max_keycode - group->min_keycode + 1, sizeof(uint32_t));
+	if (!group->keybinding_modifiers) {
+		wlr_log(WLR_ERROR, "Unable to allocate keybinding table");
+		return;
+	}
+
+	xkb_keymap_key_for_each(keymap, compile_keybindings_for_key, group);
+}
+
+static bool
+keyboard_group_may_bind(struct cg_keyboard_group *group, xkb_keycode_t keycode)
+{
+	/* Without a table, every key has to be looked up. */
+	if (!group->keybinding_modifiers) {
+		return true;
+	}
+
+	if (keycode < group->min_keycode || keycode > group->max_keycode) {
+		return false;
+	}
+
+	uint32_t modifiers = group->keybinding_modifiers[keycode - group->min_keycode];
+	return modifiers && (wlr_keyboard_get_modifiers(&group->wlr_group->keyboard) & modifiers);
+}
+
+static void
+handle_key_event(struct cg_keyboard_group *group, void *data)
+{
+	struct wlr_input_device *device = group->wlr_group->input_device;
+	struct cg_seat *seat = group->seat;
 	struct wlr_event_keyboard_key *event = data;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	/* Translate from libinput keycode to an xkbcommon keycode. */
 	xkb_keycode_t keycode = event->keycode + 8;
 
-	const xkb_keysym_t *syms;
-	int nsyms = xkb_state_key_get_syms(device->keyboard->xkb_state, keycode, &syms);
-
 	bool handled = false;
-	uint32_t modifiers = wlr_keyboard_get_modifiers(device->keyboard);
-	if ((modifiers & WLR_MODIFIER_ALT) && event->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
-		/* If Alt is held down and this button was pressed, we
-		 * attempt to process it as a compositor
-		 * keybinding. */
-		for (int i = 0; i < nsyms; i++) {
-			handled = handle_keybinding(seat->server, syms[i]);
-		}
+	if (event->state == WL_KEYBOARD_KEY_STATE_PRESSED && keyboard_group_may_bind(group, keycode)) {
+		/* If this key can produce a keybinding with the
+		 * modifiers currently held down, we attempt to
+		 * process it as a compositor keybinding. */
+		handled = handle_keybinding(seat->server, device->keyboard, keycode);
+	} else {
+		seat->keys_fast_path++;
 	}
 
 	if (!handled) {
@@ -277,13 +405,21 @@ handle_key_event(struct wlr_input_device *device, struct cg_seat *seat, void *da
 	}
 
 	wlr_idle_notify_activity(seat->server->idle, seat->seat);
+	event_stats_record(&seat->key_stats, &start);
 }
 
 static void
 handle_keyboard_group_key(struct wl_listener *listener, void *data)
 {
 	struct cg_keyboard_group *cg_group = wl_container_of(listener, cg_group, key);
-	handle_key_event(cg_group->wlr_group->input_device, cg_group->seat, data);
+	handle_key_event(cg_group, data);
+}
+
+static void
+handle_keyboard_group_keymap(struct wl_listener *listener, void *data)
+{
+	struct cg_keyboard_group *group = wl_container_of(listener, group, keymap);
+	keyboard_group_compile_keybindings(group);
 }
 
 static void
@@ -336,6 +472,10 @@ cg_keyboard_group_add(struct wlr_input_device *device, struct cg_seat *seat)
 	cg_group->key.notify = handle_keyboard_group_key;
 	wl_signal_add(&cg_group->wlr_group->keyboard.events.modifiers, &cg_group->modifiers);
 	cg_group->modifiers.notify = handle_keyboard_group_modifiers;
+	wl_signal_add(&cg_group->wlr_group->keyboard.events.keymap, &cg_group->keymap);
+	cg_group->keymap.notify = handle_keyboard_group_keymap;
+
+	keyboard_group_compile_keybindings(cg_group);
 
 	return;
 
@@ -378,6 +518,8 @@ handle_new_input(struct wl_listener *listener, void *data)
 {
 	struct cg_seat *seat = wl_container_of(listener, seat, new_input);
 	struct wlr_input_device *device = data;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	switch (device->type) {
 	case WLR_INPUT_DEVICE_KEYBOARD:
@@ -399,6 +541,7 @@ handle_new_input(struct wl_listener *listener, void *data)
 	}
 
 	update_capabilities(seat);
+	event_stats_record(&seat->server->new_input_stats, &start);
 }
 
 static void
@@ -433,7 +576,7 @@ handle_request_set_cursor(struct wl_listener *listener, void *data)
 
 	/* This can be sent by any client, so we check to make sure
 	 * this one actually has pointer focus first. */
-	if (focused_client == event->seat_client->client) {
+	if (focused_client == event->seat_client->client && !seat_has_drag_icon_on_cursor(seat)) {
 		wlr_cursor_set_surface(seat->cursor, event->surface, event->hotspot_x, event->hotspot_y);
 	}
 }
@@ -449,10 +592,10 @@ handle_touch_down(struct wl_listener *listener, void *data)
 
 	double sx, sy;
 	struct wlr_surface *surface;
-	struct cg_view *view = desktop_view_at(seat->server, lx, ly, &surface, &sx, &sy);
+	desktop_view_at(seat->server, lx, ly, &surface, &sx, &sy);
 
 	uint32_t serial = 0;
-	if (view) {
+	if (surface) {
 		serial = wlr_seat_touch_notify_down(seat->seat, surface, event->time_msec, event->touch_id, sx, sy);
 	}
 
@@ -500,9 +643,9 @@ handle_touch_motion(struct wl_listener *listener, void *data)
 
 	double sx, sy;
 	struct wlr_surface *surface;
-	struct cg_view *view = desktop_view_at(seat->server, lx, ly, &surface, &sx, &sy);
+	desktop_view_at(seat->server, lx, ly, &surface, &sx, &sy);
 
-	if (view) {
+	if (surface) {
 		wlr_seat_touch_point_focus(seat->seat, surface, event->time_msec, event->touch_id, sx, sy);
 		wlr_seat_touch_notify_motion(seat->seat, event->time_msec, event->touch_id, sx, sy);
 	} else {
@@ -556,9 +699,9 @@ process_cursor_motion(struct cg_seat *seat, uint32_t time)
 	struct wlr_seat *wlr_seat = seat->seat;
 	struct wlr_surface *surface = NULL;
 
-	struct cg_view *view = desktop_view_at(seat->server, seat->cursor->x, seat->cursor->y, &surface, &sx, &sy);
+	desktop_view_at(seat->server, seat->cursor->x, seat->cursor->y, &surface, &sx, &sy);
 
-	if (!view) {
+	if (!surface) {
 		wlr_seat_pointer_clear_focus(wlr_seat);
 	} else {
 		wlr_seat_pointer_notify_enter(wlr_seat, surface, sx, sy);
@@ -602,12 +745,92 @@ handle_cursor_motion(struct wl_listener *listener, void *data)
 static void
 drag_icon_damage(struct cg_drag_icon *drag_icon)
 {
+	/* Moving the cursor plane doesn't need a new frame. */
+	if (drag_icon->on_cursor) {
+		return;
+	}
+
 	struct cg_output *output;
 	wl_list_for_each (output, &drag_icon->seat->server->outputs, link) {
 		output_damage_surface(output, drag_icon->wlr_drag_icon->surface, drag_icon->lx, drag_icon->ly, true);
 	}
 }
 
+static bool
+seat_has_drag_icon_on_cursor(struct cg_seat *seat)
+{
+	struct cg_drag_icon *drag_icon;
+	wl_list_for_each (drag_icon, &seat->drag_icons, link) {
+		if (drag_icon->on_cursor) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool
+drag_icon_fits_cursor_plane(struct cg_drag_icon *drag_icon)
+{
+	struct wlr_drag_icon *wlr_icon = drag_icon->wlr_drag_icon;
+	struct wlr_surface *surface = wlr_icon->surface;
+
+	if (drag_icon->cursor_plane_failed || !wlr_icon->mapped ||
+	    wlr_icon->drag->grab_type != WLR_DRAG_GRAB_KEYBOARD_POINTER) {
+		return false;
+	}
+
+	/* Only the icon's own surface ends up on the cursor plane. */
+	if (!wl_list_empty(&surface->subsurfaces_below) || !wl_list_empty(&surface->subsurfaces_above)) {
+		return false;
+	}
+
+	return surface->current.buffer_width <= DRAG_ICON_CURSOR_MAX_SIZE &&
+	       surface->current.buffer_height <= DRAG_ICON_CURSOR_MAX_SIZE;
+}
+
+/* Shows small drag icons on the cursor plane in place of the cursor
+ * image, so that dragging doesn't force the output out of direct
+ * scan-out. Icons that don't fit are composited as usual. */
+static void
+drag_icon_update_cursor_plane(struct cg_drag_icon *drag_icon)
+{
+	struct cg_seat *seat = drag_icon->seat;
+
+	bool fits = drag_icon_fits_cursor_plane(drag_icon);
+	bool on_cursor = fits;
+	if (on_cursor && !drag_icon->on_cursor) {
+		/* Composited drag icons are drawn with their top-left
+		   corner at the cursor position. */
+		wlr_cursor_set_surface(seat->cursor, drag_icon->wlr_drag_icon->surface, 0, 0);
+	}
+
+	/* wlroots falls back to software cursors when the icon can't
+	   be shown on the output's cursor plane, which gains nothing
+	   over compositing it ourselves. */
+	if (on_cursor) {
+		struct wlr_output *wlr_output =
+			wlr_output_layout_output_at(seat->server->output_layout, seat->cursor->x, seat->cursor->y);
+		if (wlr_output && !wlr_output->hardware_cursor) {
+			wlr_log(WLR_DEBUG, "Cannot show drag icon on the cursor plane of output %s", wlr_output->name);
+			drag_icon->cursor_plane_failed = true;
+			on_cursor = false;
+		}
+	}
+
+	if (!on_cursor && (fits || drag_icon->on_cursor)) {
+		wlr_xcursor_manager_set_cursor_image(seat->xcursor_manager, DEFAULT_XCURSOR, seat->cursor);
+	}
+
+	if (on_cursor == drag_icon->on_cursor) {
+		return;
+	}
+
+	drag_icon_damage(drag_icon);
+	drag_icon->on_cursor = on_cursor;
+	drag_icon_damage(drag_icon);
+}
+
 static void
 drag_icon_update_position(struct cg_drag_icon *drag_icon)
 {
@@ -635,6 +858,34 @@ drag_icon_update_position(struct cg_drag_icon *drag_icon)
 	}
 
 	drag_icon_damage(drag_icon);
+	drag_icon_update_cursor_plane(drag_icon);
+}
+
+static void
+handle_drag_icon_map(struct wl_listener *listener, void *data)
+{
+	struct cg_drag_icon *drag_icon = wl_container_of(listener, drag_icon, map);
+
+	drag_icon_update_cursor_plane(drag_icon);
+	drag_icon_damage(drag_icon);
+}
+
+static void
+handle_drag_icon_unmap(struct wl_listener *listener, void *data)
+{
+	struct cg_drag_icon *drag_icon = wl_container_of(listener, drag_icon, unmap);
+
+	drag_icon_damage(drag_icon);
+	drag_icon_update_cursor_plane(drag_icon);
+}
+
+static void
+handle_drag_icon_commit(struct wl_listener *listener, void *data)
+{
+	struct cg_drag_icon *drag_icon = wl_container_of(listener, drag_icon, commit);
+
+	/* The icon may have outgrown the cursor plane. */
+	drag_icon_update_cursor_plane(drag_icon);
 }
 
 static void
@@ -642,8 +893,16 @@ handle_drag_icon_destroy(struct wl_listener *listener, void *data)
 {
 	struct cg_drag_icon *drag_icon = wl_container_of(listener, drag_icon, destroy);
 
+	if (drag_icon->on_cursor) {
+		wlr_xcursor_manager_set_cursor_image(drag_icon->seat->xcursor_manager, DEFAULT_XCURSOR,
+						     drag_icon->seat->cursor);
+	}
+
 	drag_icon_damage(drag_icon);
 	wl_list_remove(&drag_icon->link);
+	wl_list_remove(&drag_icon->map.link);
+	wl_list_remove(&drag_icon->unmap.link);
+	wl_list_remove(&drag_icon->commit.link);
 	wl_list_remove(&drag_icon->destroy.link);
 	free(drag_icon);
 }
@@ -688,6 +947,12 @@ handle_start_drag(struct wl_listener *listener, void *data)
 	drag_icon->seat = seat;
 	drag_icon->wlr_drag_icon = wlr_drag_icon;
 
+	drag_icon->map.notify = handle_drag_icon_map;
+	wl_signal_add(&wlr_drag_icon->events.map, &drag_icon->map);
+	drag_icon->unmap.notify = handle_drag_icon_unmap;
+	wl_signal_add(&wlr_drag_icon->events.unmap, &drag_icon->unmap);
+	drag_icon->commit.notify = handle_drag_icon_commit;
+	wl_signal_add(&wlr_drag_icon->surface->events.commit, &drag_icon->commit);
 	drag_icon->destroy.notify = handle_drag_icon_destroy;
 	wl_signal_add(&wlr_drag_icon->events.destroy, &drag_icon->destroy);
 
@@ -716,6 +981,7 @@ handle_destroy(struct wl_listener *listener, void *data)
 	struct cg_keyboard_group *group, *group_tmp;
 	wl_list_for_each_safe (group, group_tmp, &seat->keyboard_groups, link) {
 		wlr_keyboard_group_destroy(group->wlr_group);
+		free(group->keybinding_modifiers);
 		free(group);
 	}
 	struct cg_pointer *pointer, *pointer_tmp;
@@ -835,17 +1101,25 @@ struct cg_view *
 seat_get_focus(struct cg_seat *seat)
 {
 	struct wlr_surface *prev_surface = seat->seat->keyboard_state.focused_surface;
-	return view_from_wlr_surface(seat->server, prev_surface);
+	struct cg_view *view = view_from_wlr_surface(seat->server, prev_surface);
+
+	/* The keyboard is on a surface that isn't a view's, which can
+	   only be an override-redirect window. */
+	if (!view && prev_surface) {
+		return seat->focused_view;
+	}
+	return view;
 }
 
 void
 seat_set_focus(struct cg_seat *seat, struct cg_view *view)
 {
 	struct cg_server *server = seat->server;
-	struct wlr_seat *wlr_seat = seat->seat;
 	struct cg_view *prev_view = seat_get_focus(seat);
 
-	if (!view || prev_view == view) {
+	/* The view may be focused while an override-redirect window
+	   holds the keyboard; focusing it again takes the keyboard back. */
+	if (!view || (prev_view == view && seat->seat->keyboard_state.focused_surface == view->wlr_surface)) {
 		return;
 	}
 
@@ -858,7 +1132,7 @@ seat_set_focus(struct cg_seat *seat, struct cg_view *view)
 	}
 #endif
 
-	if (prev_view) {
+	if (prev_view && prev_view != view) {
 		view_activate(prev_view, false);
 	}
 
@@ -877,13 +1151,24 @@ seat_set_focus(struct cg_seat *seat, struct cg_view *view)
 	}
 	free(title);
 
+	seat->focused_view = view;
+	seat_focus_surface(seat, view->wlr_surface);
+
+	process_cursor_motion(seat, -1);
+}
+
+/* Gives the keyboard to a surface, without changing the focused view
+ * unless the surface belongs to one. */
+void
+seat_focus_surface(struct cg_seat *seat, struct wlr_surface *surface)
+{
+	struct wlr_seat *wlr_seat = seat->seat;
+
 	struct wlr_keyboard *keyboard = wlr_seat_get_keyboard(wlr_seat);
 	if (keyboard) {
-		wlr_seat_keyboard_notify_enter(wlr_seat, view->wlr_surface, keyboard->keycodes, keyboard->num_keycodes,
+		wlr_seat_keyboard_notify_enter(wlr_seat, surface, keyboard->keycodes, keyboard->num_keycodes,
 					       &keyboard->modifiers);
 	} else {
-		wlr_seat_keyboard_notify_enter(wlr_seat, view->wlr_surface, NULL, 0, NULL);
+		wlr_seat_keyboard_notify_enter(wlr_seat, surface, NULL, 0, NULL);
 	}
-
-	process_cursor_motion(seat, -1);
 }
@@ -7,8 +7,10 @@
 #include <wlr/types/wlr_input_device.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/types/wlr_xcursor_manager.h>
+#include <xkbcommon/xkbcommon.h>
 
 #include "server.h"
+#include "util.h"
 #include "view.h"
 
 #define DEFAULT_XCURSOR "left_ptr"
@@ -19,8 +21,15 @@ struct cg_seat {
 	struct cg_server *server;
 	struct wl_listener destroy;
 
+	/* The view last given focus. It stays focused while an
+	 * override-redirect X11 window holds the keyboard. */
+	struct cg_view *focused_view;
+
 	struct wl_list keyboards;
 	struct wl_list keyboard_groups;
+	struct cg_event_stats key_stats;
+	/* Keys passed on without looking up their keysyms. */
+	unsigned int keys_fast_path;
 	struct wl_list pointers;
 	struct wl_list touch;
 	struct wl_listener new_input;
@@ -54,7 +63,12 @@ struct cg_keyboard_group {
 	struct cg_seat *seat;
 	struct wl_listener key;
 	struct wl_listener modifiers;
+	struct wl_listener keymap;
 	struct wl_list link; // cg_seat::keyboard_groups
+
+	/* Modifiers required by keybindings, indexed by keycode. */
+	uint32_t *keybinding_modifiers;
+	xkb_keycode_t min_keycode, max_keycode;
 };
 
 struct cg_pointer {
@@ -80,7 +94,13 @@ struct cg_drag_icon {
 
 	/* The drag icon has a position in layout coordinates. */
 	double lx, ly;
+	/* Shown on the cursor plane instead of being composited. */
+	bool on_cursor;
+	bool cursor_plane_failed;
 
+	struct wl_listener map;
+	struct wl_listener unmap;
+	struct wl_listener commit;
 	struct wl_listener destroy;
 };
 
@@ -88,5 +108,6 @@ struct cg_seat *seat_create(struct cg_server *server, struct wlr_backend *backen
 void seat_destroy(struct cg_seat *seat);
 struct cg_view *seat_get_focus(struct cg_seat *seat);
 void seat_set_focus(struct cg_seat *seat, struct cg_view *view);
+void seat_focus_surface(struct cg_seat *seat, struct wlr_surface *surface);
 
 #endif
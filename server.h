@@ -3,17 +3,20 @@
 
 #include "config.h"
 
+#include <time.h>
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_idle.h>
 #include <wlr/types/wlr_idle_inhibit_v1.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_xdg_decoration_v1.h>
 #if CAGE_HAS_XWAYLAND
+#include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/xwayland.h>
 #endif
 
 #include "output.h"
 #include "seat.h"
+#include "util.h"
 #include "view.h"
 
 enum cg_multi_output_mode {
@@ -32,6 +35,12 @@ struct cg_server {
 	struct wl_listener new_idle_inhibitor_v1;
 	struct wl_list inhibitors;
 
+	struct wl_list clients; // cg_client::link
+	struct wl_protocol_logger *protocol_logger;
+	/* The surface whose commit request is being dispatched. */
+	struct wl_resource *commit_surface;
+	struct timespec commit_requested;
+
 	enum cg_multi_output_mode output_mode;
 	struct wlr_output_layout *output_layout;
 	/* Includes disabled outputs; depending on the output_mode
@@ -42,14 +51,51 @@ struct cg_server {
 	struct wl_listener xdg_toplevel_decoration;
 	struct wl_listener new_xdg_shell_surface;
 #if CAGE_HAS_XWAYLAND
+	struct wlr_xwayland *xwayland;
+	struct wlr_xcursor_manager *xwayland_xcursor_manager;
 	struct wl_listener new_xwayland_surface;
+	struct wl_listener xwayland_ready;
+	struct wl_list xwayland_unmanaged; // cg_xwayland_unmanaged::link
+	unsigned int n_xwayland_surfaces;
+	/* Stops Xwayland once it has been without clients for this long. */
+	int xwayland_idle_timeout; // seconds, 0 if disabled
+	struct wl_event_source *xwayland_idle_timer;
+	struct cg_xwayland_probe *xwayland_probe; // NULL unless counting clients
+	unsigned int xwayland_idle_stops;
+	/* Time from Xwayland being launched to it being ready. */
+	struct cg_event_stats xwayland_start_stats;
 #endif
 
 	bool xdg_decoration;
 	bool allow_vt_switch;
+	bool match_refresh;
+	struct wl_event_source *refresh_match_timer;
+	bool benchmark;
+	bool view_cache;
+	size_t view_cache_size; // bytes
+	bool shadow_buffer;
+	bool time_client_commits;
 	enum wl_output_transform output_transform;
+
+	/* Lifecycle accounting, see log_statistics(). */
+	unsigned int n_views;
+	unsigned int n_view_children;
+	struct cg_event_stats new_output_stats;
+	struct cg_event_stats output_destroy_stats;
+	struct cg_event_stats new_input_stats;
+	struct cg_event_stats view_map_stats;
+	struct cg_event_stats view_unmap_stats;
+	struct cg_event_stats view_destroy_stats;
+#if CAGE_HAS_XWAYLAND
+	unsigned int n_xwayland_unmanaged;
+	/* Time spent on each override-redirect window over its lifetime. */
+	struct cg_event_stats xwayland_unmanaged_stats;
+#endif
 #ifdef DEBUG
 	bool debug_damage_tracking;
+	/* Adds and removes headless devices every this often. */
+	int stress_interval; // ms, 0 if disabled
+	struct cg_stress *stress;
 #endif
 };
 
@@ -0,0 +1,115 @@
+/*
+ * Cage: A Wayland kiosk.
+ *
+ * Copyright (C) 2018-2020 Jente Hidskes
+ *
+ * See the LICENSE file accompanying this file.
+ */
+
+#include <stdlib.h>
+#include <wayland-server-core.h>
+#include <wlr/backend.h>
+#include <wlr/backend/headless.h>
+#include <wlr/backend/multi.h>
+#include <wlr/interfaces/wlr_input_device.h>
+#include <wlr/types/wlr_input_device.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+
+#include "server.h"
+#include "stress.h"
+
+#define STRESS_OUTPUT_WIDTH 1280
+#define STRESS_OUTPUT_HEIGHT 720
+
+static void
+find_headless_backend(struct wlr_backend *backend, void *data)
+{
+	struct wlr_backend **headless = data;
+	if (wlr_backend_is_headless(backend)) {
+		*headless = backend;
+	}
+}
+
+/* Adds the devices of a cycle on one tick and removes them on the
+ * next, so every tick runs either the creation or the destruction
+ * paths. */
+static int
+handle_stress_timer(void *data)
+{
+	struct cg_stress *stress = data;
+
+	if (stress->output) {
+		wlr_input_device_destroy(stress->pointer);
+		wlr_input_device_destroy(stress->keyboard);
+		wlr_output_destroy(stress->output);
+		stress->pointer = NULL;
+		stress->keyboard = NULL;
+		stress->output = NULL;
+		stress->cycles++;
+	} else {
+		stress->output = wlr_headless_add_output(stress->headless, STRESS_OUTPUT_WIDTH, STRESS_OUTPUT_HEIGHT);
+		stress->keyboard = wlr_headless_add_input_device(stress->headless, WLR_INPUT_DEVICE_KEYBOARD);
+		stress->pointer = wlr_headless_add_input_device(stress->headless, WLR_INPUT_DEVICE_POINTER);
+		if (!stress->output || !stress->keyboard || !stress->pointer) {
+			wlr_log(WLR_ERROR, "Unable to add headless devices, stopping the stress cycles");
+			return 0;
+		}
+	}
+
+	wl_event_source_timer_update(stress->timer, stress->server->stress_interval);
+	return 0;
+}
+
+struct cg_stress *
+stress_create(struct cg_server *server, struct wl_event_loop *event_loop)
+{
+	struct wlr_backend *headless = NULL;
+	if (wlr_backend_is_multi(server->backend)) {
+		wlr_multi_for_each_backend(server->backend, find_headless_backend, &headless);
+	} else if (wlr_backend_is_headless(server->backend)) {
+		headless = server->backend;
+	}
+	if (!headless) {
+		wlr_log(WLR_ERROR, "Stress cycles need the headless backend, run with WLR_BACKENDS=headless");
+		return NULL;
+	}
+
+	struct cg_stress *stress = calloc(1, sizeof(struct cg_stress));
+	if (!stress) {
+		wlr_log(WLR_ERROR, "Failed to allocate the stress cycles");
+		return NULL;
+	}
+
+	stress->server = server;
+	stress->headless = headless;
+	stress->timer = wl_event_loop_add_timer(event_loop, handle_stress_timer, stress);
+	if (!stress->timer) {
+		wlr_log(WLR_ERROR, "Unable to create the stress timer");
+		free(stress);
+		return NULL;
+	}
+	wl_event_source_timer_update(stress->timer, server->stress_interval);
+
+	return stress;
+}
+
+/* The devices of an unfinished cycle are left to the backend, which
+ * destroys them along with itself. */
+void
+stress_destroy(struct cg_stress *stress)
+{
+	if (!stress) {
+		return;
+	}
+
+	wl_event_source_remove(stress->timer);
+	free(stress);
+}
+
+void
+stress_log_statistics(struct cg_stress *stress)
+{
+	wlr_log(WLR_INFO, "Stress: %u cycles of adding and removing an output, keyboard and pointer",
+		stress->cycles);
+}
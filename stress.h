@@ -0,0 +1,30 @@
+#ifndef CG_STRESS_H
+#define CG_STRESS_H
+
+#include <wayland-server-core.h>
+#include <wlr/backend.h>
+#include <wlr/types/wlr_input_device.h>
+#include <wlr/types/wlr_output.h>
+
+#include "server.h"
+
+/* Adds and removes a virtual output, keyboard and pointer on the
+ * headless backend, to find leaks and slowdowns in the code paths
+ * that handle them. Only built in debug builds. */
+struct cg_stress {
+	struct cg_server *server;
+	struct wlr_backend *headless;
+	struct wl_event_source *timer;
+
+	/* Set while the devices of the current cycle exist. */
+	struct wlr_output *output;
+	struct wlr_input_device *keyboard;
+	struct wlr_input_device *pointer;
+	unsigned int cycles;
+};
+
+struct cg_stress *stress_create(struct cg_server *server, struct wl_event_loop *event_loop);
+void stress_destroy(struct cg_stress *stress);
+void stress_log_statistics(struct cg_stress *stress);
+
+#endif
@@ -6,7 +6,17 @@
  * See the LICENSE file accompanying this file.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include <wlr/types/wlr_box.h>
+#include <wlr/util/log.h>
 
 #include "util.h"
 
@@ -34,3 +44,127 @@ scale_box(struct wlr_box *box, float scale)
 	box->x = round(box->x * scale);
 	box->y = round(box->y * scale);
 }
+
+int64_t
+timespec_diff_nsec(const struct timespec *a, const struct timespec *b)
+{
+	return (int64_t) (a->tv_sec - b->tv_sec) * 1000000000 + (a->tv_nsec - b->tv_nsec);
+}
+
+void
+event_stats_record(struct cg_event_stats *stats, const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	event_stats_add(stats, timespec_diff_nsec(&now, start));
+}
+
+void
+event_stats_add(struct cg_event_stats *stats, int64_t time)
+{
+	stats->count++;
+	stats->total += time;
+	if (time > stats->max) {
+		stats->max = time;
+	}
+}
+
+void
+event_stats_log(const struct cg_event_stats *stats, const char *name)
+{
+	if (stats->count == 0) {
+		return;
+	}
+
+	wlr_log(WLR_INFO, "%s: %u handled, avg %.3f ms, max %.3f ms", name, stats->count,
+		stats->total / 1e6 / stats->count, stats->max / 1e6);
+}
+
+long
+proc_rss_kib(pid_t pid)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/status", pid);
+
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		return -1;
+	}
+
+	long rss = -1;
+	char line[256];
+	while (fgets(line, sizeof(line), file)) {
+		if (sscanf(line, "VmRSS: %ld kB", &rss) == 1) {
+			break;
+		}
+	}
+
+	fclose(file);
+	return rss;
+}
+
+int
+proc_fd_count(pid_t pid)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+
+	DIR *dir = opendir(path);
+	if (!dir) {
+		return -1;
+	}
+
+	int count = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] != '.') {
+			count++;
+		}
+	}
+
+	closedir(dir);
+	/* Don't count the descriptor used to list our own. */
+	return pid == getpid() ? count - 1 : count;
+}
+
+int64_t
+proc_age_nsec(pid_t pid)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		return -1;
+	}
+
+	char line[1024];
+	bool read = fgets(line, sizeof(line), file) != NULL;
+	fclose(file);
+	if (!read) {
+		return -1;
+	}
+
+	/* The start time is the 22nd field. The command name in the
+	   second field may contain spaces, so count from its end. */
+	char *field = strrchr(line, ')');
+	for (int i = 2; field && i < 22; i++) {
+		field = strchr(field + 1, ' ');
+	}
+	if (!field) {
+		return -1;
+	}
+
+	/* The start time is in clock ticks since boot. */
+	unsigned long long start_ticks = strtoull(field + 1, NULL, 10);
+	long ticks_per_sec = sysconf(_SC_CLK_TCK);
+	struct timespec now;
+	if (ticks_per_sec <= 0 || clock_gettime(CLOCK_BOOTTIME, &now) != 0) {
+		return -1;
+	}
+
+	int64_t start = (int64_t) (start_ticks / ticks_per_sec) * 1000000000 +
+			(int64_t) (start_ticks % ticks_per_sec) * 1000000000 / ticks_per_sec;
+	return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec - start;
+}
@@ -1,6 +1,9 @@
 #ifndef CG_UTIL_H
 #define CG_UTIL_H
 
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
 #include <wlr/types/wlr_box.h>
 
 /** Apply scale to a width or height. */
@@ -8,4 +11,27 @@ int scale_length(int length, int offset, float scale);
 
 void scale_box(struct wlr_box *box, float scale);
 
+/** Returns a - b in nanoseconds. */
+int64_t timespec_diff_nsec(const struct timespec *a, const struct timespec *b);
+
+/* Number of times an event was handled and the time spent on it. */
+struct cg_event_stats {
+	unsigned int count;
+	int64_t total; // nsec
+	int64_t max; // nsec
+};
+
+/** Records an event whose handling started at start. */
+void event_stats_record(struct cg_event_stats *stats, const struct timespec *start);
+/** Records an event that took time nanoseconds to handle. */
+void event_stats_add(struct cg_event_stats *stats, int64_t time);
+void event_stats_log(const struct cg_event_stats *stats, const char *name);
+
+/** Returns the resident set size of a process in KiB, or -1 on error. */
+long proc_rss_kib(pid_t pid);
+/** Returns the number of open file descriptors of a process, or -1 on error. */
+int proc_fd_count(pid_t pid);
+/** Returns the time since a process was started in nanoseconds, or -1 on error. */
+int64_t proc_age_nsec(pid_t pid);
+
 #endif
@@ -9,25 +9,35 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_surface.h>
 
+#include "client.h"
 #include "output.h"
 #include "seat.h"
 #include "server.h"
+#include "util.h"
 #include "view.h"
-#if CAGE_HAS_XWAYLAND
-#include "xwayland.h"
-#endif
+
+/* Commits closer together than this count towards a surface being hot. */
+#define HOT_COMMIT_INTERVAL 250 // ms
+/* Number of such commits in a row after which a surface is hot. */
+#define HOT_COMMIT_STREAK 3
+/* A hot surface that hasn't committed for this long is static again. */
+#define HOT_COMMIT_TIMEOUT 1000 // ms
 
 static void
 view_child_handle_commit(struct wl_listener *listener, void *data)
 {
 	struct cg_view_child *child = wl_container_of(listener, child, commit);
+	view_record_commit(child->view, child->wlr_surface);
 	view_damage_part(child->view);
 }
 
@@ -49,6 +59,7 @@ view_child_finish(struct cg_view_child *child)
 	}
 
 	view_damage_whole(child->view);
+	child->view->server->n_view_children--;
 
 	wl_list_remove(&child->link);
 	wl_list_remove(&child->commit.link);
@@ -67,6 +78,7 @@ view_child_init(struct cg_view_child *child, struct cg_view *view, struct wlr_su
 	wl_signal_add(&wlr_surface->events.new_subsurface, &child->new_subsurface);
 
 	wl_list_insert(&view->children, &child->link);
+	view->server->n_view_children++;
 }
 
 static void
@@ -136,6 +148,104 @@ view_is_transient_for(struct cg_view *child, struct cg_view *parent)
 	return child->impl->is_transient_for(child, parent);
 }
 
+static struct cg_surface_activity *
+view_surface_activity(struct cg_view *view, struct wlr_surface *surface)
+{
+	if (surface == view->wlr_surface) {
+		return &view->activity;
+	}
+
+	struct cg_view_child *child;
+	wl_list_for_each (child, &view->children, link) {
+		if (child->wlr_surface == surface) {
+			return &child->activity;
+		}
+	}
+
+	return NULL;
+}
+
+static bool
+surface_activity_is_hot(struct cg_surface_activity *activity, const struct timespec *now)
+{
+	return activity->streak >= HOT_COMMIT_STREAK &&
+	       timespec_diff_nsec(now, &activity->last_commit) / 1000000 < HOT_COMMIT_TIMEOUT;
+}
+
+bool
+view_surface_is_hot(struct cg_view *view, struct wlr_surface *surface, const struct timespec *now)
+{
+	struct cg_surface_activity *activity = view_surface_activity(view, surface);
+	/* Surfaces we don't know about can't be cached. */
+	return !activity || surface_activity_is_hot(activity, now);
+}
+
+void
+view_cache_invalidate(struct cg_view *view)
+{
+	struct cg_view_cache *cache = &view->cache;
+
+	if (!cache->texture) {
+		return;
+	}
+
+	wlr_texture_destroy(cache->texture);
+	view->server->view_cache_size -= cache->size;
+
+	cache->texture = NULL;
+	cache->output = NULL;
+	cache->n_surfaces = 0;
+	cache->size = 0;
+}
+
+void
+view_record_commit(struct cg_view *view, struct wlr_surface *surface)
+{
+	client_record_commit(view->server, surface);
+
+	/* Only commits that change what is on screen count towards
+	   the view's cadence and its surfaces' activity. */
+	if (!pixman_region32_not_empty(&surface->buffer_damage)) {
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	cadence_record(&view->cadence, &now);
+	latency_record_commit(&view->latency, &now);
+
+	struct cg_surface_activity *activity = view_surface_activity(view, surface);
+	if (!activity) {
+		view_cache_invalidate(view);
+		return;
+	}
+
+	/* Hot surfaces are never part of the cache, so only new content
+	   in a static surface invalidates it. */
+	if (!surface_activity_is_hot(activity, &now)) {
+		view_cache_invalidate(view);
+	}
+
+	if (timespec_diff_nsec(&now, &activity->last_commit) / 1000000 < HOT_COMMIT_INTERVAL) {
+		if (activity->streak < HOT_COMMIT_STREAK) {
+			activity->streak++;
+		}
+	} else {
+		activity->streak = 0;
+	}
+	activity->last_commit = now;
+}
+
+void
+view_log_statistics(struct cg_view *view)
+{
+	char name[128];
+	char *title = view_get_title(view);
+	snprintf(name, sizeof(name), "View '%s'", title ? title : "");
+	free(title);
+	latency_log_statistics(&view->latency, name);
+}
+
 void
 view_damage_part(struct cg_view *view)
 {
@@ -154,6 +264,17 @@ view_damage_whole(struct cg_view *view)
 	}
 }
 
+bool
+view_is_on_output(struct cg_view *view, struct wlr_output *output)
+{
+	struct wlr_box box = {
+		.x = view->lx,
+		.y = view->ly,
+	};
+	view->impl->get_geometry(view, &box.width, &box.height);
+	return wlr_output_layout_intersects(view->server->output_layout, output, &box);
+}
+
 void
 view_activate(struct cg_view *view, bool activate)
 {
@@ -217,6 +338,9 @@ view_for_each_popup_surface(struct cg_view *view, wlr_surface_iterator_func_t it
 void
 view_unmap(struct cg_view *view)
 {
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
 	wl_list_remove(&view->link);
 
 	wl_list_remove(&view->new_subsurface.link);
@@ -226,12 +350,25 @@ view_unmap(struct cg_view *view)
 		child->destroy(child);
 	}
 
+	if (view->server->seat->focused_view == view) {
+		view->server->seat->focused_view = NULL;
+	}
+
+	view_cache_invalidate(view);
 	view->wlr_surface = NULL;
+	cadence_reset(&view->cadence);
+	latency_reset(&view->latency);
+	view->activity = (struct cg_surface_activity){0};
+
+	event_stats_record(&view->server->view_unmap_stats, &start);
 }
 
 void
 view_map(struct cg_view *view, struct wlr_surface *surface)
 {
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
 	view->wlr_surface = surface;
 
 	struct wlr_subsurface *subsurface;
@@ -245,29 +382,27 @@ view_map(struct cg_view *view, struct wlr_surface *surface)
 	view->new_subsurface.notify = handle_new_subsurface;
 	wl_signal_add(&view->wlr_surface->events.new_subsurface, &view->new_subsurface);
 
-#if CAGE_HAS_XWAYLAND
-	/* We shouldn't position override-redirect windows. They set
-	   their own (x,y) coordinates in handle_wayland_surface_map. */
-	if (view->type != CAGE_XWAYLAND_VIEW || xwayland_view_should_manage(view))
-#endif
-	{
-		view_position(view);
-	}
+	view_position(view);
 
 	wl_list_insert(&view->server->views, &view->link);
 	seat_set_focus(view->server->seat, view);
+
+	event_stats_record(&view->server->view_map_stats, &start);
 }
 
 void
 view_destroy(struct cg_view *view)
 {
 	struct cg_server *server = view->server;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	if (view->wlr_surface != NULL) {
 		view_unmap(view);
 	}
 
 	view->impl->destroy(view);
+	server->n_views--;
 
 	/* If there is a previous view in the list, focus that. */
 	bool empty = wl_list_empty(&server->views);
@@ -275,6 +410,8 @@ view_destroy(struct cg_view *view)
 		struct cg_view *prev = wl_container_of(server->views.next, prev, link);
 		seat_set_focus(server->seat, prev);
 	}
+
+	event_stats_record(&server->view_destroy_stats, &start);
 }
 
 void
@@ -285,6 +422,7 @@ view_init(struct cg_view *view, struct cg_server *server, enum cg_view_type type
 	view->impl = impl;
 
 	wl_list_init(&view->children);
+	server->n_views++;
 }
 
 struct cg_view *
@@ -4,7 +4,9 @@
 #include "config.h"
 
 #include <stdbool.h>
+#include <time.h>
 #include <wayland-server-core.h>
+#include <wlr/render/wlr_texture.h>
 #include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_surface.h>
 #include <wlr/types/wlr_xdg_shell.h>
@@ -12,6 +14,8 @@
 #include <wlr/xwayland.h>
 #endif
 
+#include "cadence.h"
+#include "latency.h"
 #include "server.h"
 
 enum cg_view_type {
@@ -21,6 +25,26 @@ enum cg_view_type {
 #endif
 };
 
+/* Tracks how often a surface commits new content. Surfaces that
+ * commit in quick succession are hot, all others are static. */
+struct cg_surface_activity {
+	struct timespec last_commit;
+	unsigned int streak;
+};
+
+/* Pre-composited contents of the static surfaces at the bottom of a
+ * view's surface tree. See render.c. */
+struct cg_view_cache {
+	struct wlr_texture *texture;
+	struct cg_output *output;
+	/* Output-buffer coordinates. */
+	struct wlr_box box;
+	size_t n_surfaces;
+	uint32_t key;
+	size_t size; // bytes
+	struct timespec last_build;
+};
+
 struct cg_view {
 	struct cg_server *server;
 	struct wl_list link; // server::views
@@ -33,6 +57,14 @@ struct cg_view {
 	enum cg_view_type type;
 	const struct cg_view_impl *impl;
 
+	/* Rate at which the view presents new content. */
+	struct cg_cadence cadence;
+	/* Time its new content takes to reach the screen. */
+	struct cg_latency latency;
+	/* Activity of the view's own surface; its children track theirs. */
+	struct cg_surface_activity activity;
+	struct cg_view_cache cache;
+
 	struct wl_listener new_subsurface;
 };
 
@@ -54,6 +86,8 @@ struct cg_view_child {
 	struct wlr_surface *wlr_surface;
 	struct wl_list link;
 
+	struct cg_surface_activity activity;
+
 	struct wl_listener commit;
 	struct wl_listener new_subsurface;
 
@@ -70,8 +104,13 @@ struct cg_subsurface {
 char *view_get_title(struct cg_view *view);
 bool view_is_primary(struct cg_view *view);
 bool view_is_transient_for(struct cg_view *child, struct cg_view *parent);
+void view_record_commit(struct cg_view *view, struct wlr_surface *surface);
+bool view_surface_is_hot(struct cg_view *view, struct wlr_surface *surface, const struct timespec *now);
+void view_cache_invalidate(struct cg_view *view);
+void view_log_statistics(struct cg_view *view);
 void view_damage_part(struct cg_view *view);
 void view_damage_whole(struct cg_view *view);
+bool view_is_on_output(struct cg_view *view, struct wlr_output *output);
 void view_activate(struct cg_view *view, bool activate);
 void view_position(struct cg_view *view);
 void view_for_each_surface(struct cg_view *view, wlr_surface_iterator_func_t iterator, void *data);
@@ -6,29 +6,539 @@
  * See the LICENSE file accompanying this file.
  */
 
+#define _POSIX_C_SOURCE 200112L
+
+#include <signal.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_surface.h>
 #include <wlr/util/log.h>
 #include <wlr/xwayland.h>
+#include <xcb/res.h>
+#include <xcb/xcb.h>
 
+#include "output.h"
+#include "seat.h"
 #include "server.h"
+#include "util.h"
 #include "view.h"
 #include "xwayland.h"
 
+/* wlroots only relaunches Xwayland if it ran for longer than this;
+ * otherwise it takes the exit for a crash loop. */
+#define XWAYLAND_MIN_UPTIME 5 // s
+/* How long the client count may take before Xwayland is taken to be
+ * busy, and kept running. */
+#define XWAYLAND_PROBE_TIMEOUT 1000 // ms
+
+static void
+xwayland_surface_created(struct cg_server *server)
+{
+	server->n_xwayland_surfaces++;
+	if (server->xwayland_idle_timer) {
+		wl_event_source_timer_update(server->xwayland_idle_timer, 0);
+	}
+}
+
+static void
+xwayland_surface_destroyed(struct cg_server *server)
+{
+	server->n_xwayland_surfaces--;
+	if (server->n_xwayland_surfaces == 0 && server->xwayland_idle_timer) {
+		wl_event_source_timer_update(server->xwayland_idle_timer, server->xwayland_idle_timeout * 1000);
+	}
+}
+
+/* Returns the pid of the running Xwayland server, or 0 if there is none. */
+static pid_t
+xwayland_pid(struct cg_server *server)
+{
+	struct wlr_xwayland_server *xwayland_server = server->xwayland->server;
+	if (!xwayland_server || !xwayland_server->client) {
+		return 0;
+	}
+
+	pid_t pid;
+	wl_client_get_credentials(xwayland_server->client, &pid, NULL, NULL);
+	return pid;
+}
+
+/* Returns the number of X11 clients connected to Xwayland besides
+ * Cage's own, or -1 if they can't be counted. This waits for
+ * Xwayland, which may itself be waiting for the compositor, so it is
+ * only called from the probe's child process. */
+static int
+xwayland_count_clients(const char *display_name, pid_t compositor)
+{
+	xcb_connection_t *conn = xcb_connect(display_name, NULL);
+	if (xcb_connection_has_error(conn)) {
+		xcb_disconnect(conn);
+		return -1;
+	}
+
+	/* Lists the pid of every local client; the server's own client
+	   has none and isn't listed. */
+	xcb_res_client_id_spec_t spec = {
+		.client = 0,
+		.mask = XCB_RES_CLIENT_ID_MASK_LOCAL_CLIENT_PID,
+	};
+	xcb_res_query_client_ids_cookie_t cookie = xcb_res_query_client_ids(conn, 1, &spec);
+	xcb_res_query_client_ids_reply_t *reply = xcb_res_query_client_ids_reply(conn, cookie, NULL);
+	if (!reply) {
+		xcb_disconnect(conn);
+		return -1;
+	}
+
+	/* The window manager is Cage's, the probe's connection is ours. */
+	int n_clients = 0;
+	pid_t self = getpid();
+	xcb_res_client_id_value_iterator_t iter = xcb_res_query_client_ids_ids_iterator(reply);
+	for (; iter.rem; xcb_res_client_id_value_next(&iter)) {
+		pid_t pid = xcb_res_client_id_value_value(iter.data)[0];
+		if (pid != compositor && pid != self) {
+			n_clients++;
+		}
+	}
+
+	free(reply);
+	xcb_disconnect(conn);
+	return n_clients;
+}
+
+static void
+xwayland_stop(struct cg_server *server, pid_t pid)
+{
+	long xwayland_rss = proc_rss_kib(pid);
+	long cage_rss = proc_rss_kib(getpid());
+
+	/* Xwayland exits once its Wayland connection is gone. wlroots
+	   keeps listening on the X11 sockets, so DISPLAY stays valid and
+	   the next X11 client launches Xwayland again. */
+	wl_client_destroy(server->xwayland->server->client);
+	server->xwayland_idle_stops++;
+
+	wlr_log(WLR_INFO, "Stopped idle Xwayland with %ld KiB resident; Cage went from %ld to %ld KiB resident",
+		xwayland_rss, cage_rss, proc_rss_kib(getpid()));
+}
+
+/* Returns the pid of Xwayland if it may be stopped right now, or 0. */
+static pid_t
+xwayland_idle_pid(struct cg_server *server)
+{
+	pid_t pid = xwayland_pid(server);
+	if (server->n_xwayland_surfaces > 0 || !pid || !server->xwayland->server->ready) {
+		return 0;
+	}
+	return pid;
+}
+
+static void
+xwayland_probe_finish(struct cg_xwayland_probe *probe, int n_clients)
+{
+	struct cg_server *server = probe->server;
+
+	wl_event_source_remove(probe->readable);
+	wl_event_source_remove(probe->timeout);
+	close(probe->fd);
+	waitpid(probe->pid, NULL, 0);
+	server->xwayland_probe = NULL;
+	free(probe);
+
+	/* A window may have been mapped, or Xwayland may have exited,
+	   while the probe ran. */
+	pid_t pid = xwayland_idle_pid(server);
+	if (!pid) {
+		return;
+	}
+
+	/* X11 clients can stay connected without a window, e.g. a
+	   launcher waiting to start the next application. Xwayland is
+	   only stopped once they are all gone; until then, it is checked
+	   again after another timeout. */
+	if (n_clients == 0) {
+		xwayland_stop(server, pid);
+		return;
+	}
+
+	if (n_clients < 0) {
+		wlr_log(WLR_DEBUG, "Cannot count the X11 clients, keeping Xwayland running");
+	} else {
+		wlr_log(WLR_DEBUG, "Keeping Xwayland running for %d X11 clients without windows", n_clients);
+	}
+	wl_event_source_timer_update(server->xwayland_idle_timer, server->xwayland_idle_timeout * 1000);
+}
+
+static int
+handle_xwayland_probe_readable(int fd, uint32_t mask, void *data)
+{
+	struct cg_xwayland_probe *probe = data;
+
+	int n_clients;
+	if (read(fd, &n_clients, sizeof(n_clients)) != sizeof(n_clients)) {
+		n_clients = -1;
+	}
+
+	xwayland_probe_finish(probe, n_clients);
+	return 0;
+}
+
+static int
+handle_xwayland_probe_timeout(void *data)
+{
+	struct cg_xwayland_probe *probe = data;
+
+	wlr_log(WLR_DEBUG, "Xwayland did not answer within %d ms", XWAYLAND_PROBE_TIMEOUT);
+	kill(probe->pid, SIGKILL);
+	xwayland_probe_finish(probe, -1);
+	return 0;
+}
+
+/* Counts the X11 clients in a child process, so that the compositor
+ * never waits for Xwayland. Its answer arrives through a pipe. */
+static bool
+xwayland_probe_start(struct cg_server *server)
+{
+	struct cg_xwayland_probe *probe = calloc(1, sizeof(struct cg_xwayland_probe));
+	if (!probe) {
+		wlr_log(WLR_ERROR, "Failed to allocate the Xwayland client probe");
+		return false;
+	}
+
+	int fd[2];
+	if (pipe(fd) != 0) {
+		wlr_log_errno(WLR_ERROR, "Unable to create pipe");
+		free(probe);
+		return false;
+	}
+
+	pid_t compositor = getpid();
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(fd[0]);
+		int n_clients = xwayland_count_clients(server->xwayland->display_name, compositor);
+		_exit(write(fd[1], &n_clients, sizeof(n_clients)) == sizeof(n_clients) ? 0 : 1);
+	} else if (pid == -1) {
+		wlr_log_errno(WLR_ERROR, "Unable to fork");
+		close(fd[0]);
+		close(fd[1]);
+		free(probe);
+		return false;
+	}
+
+	close(fd[1]);
+	probe->server = server;
+	probe->pid = pid;
+	probe->fd = fd[0];
+
+	/* The pipe hangs up without data if the child failed. */
+	struct wl_event_loop *event_loop = wl_display_get_event_loop(server->wl_display);
+	uint32_t mask = WL_EVENT_READABLE | WL_EVENT_HANGUP | WL_EVENT_ERROR;
+	probe->readable = wl_event_loop_add_fd(event_loop, probe->fd, mask, handle_xwayland_probe_readable, probe);
+	probe->timeout = wl_event_loop_add_timer(event_loop, handle_xwayland_probe_timeout, probe);
+	if (!probe->readable || !probe->timeout) {
+		wlr_log(WLR_ERROR, "Unable to watch the Xwayland client probe");
+		if (probe->readable) {
+			wl_event_source_remove(probe->readable);
+		}
+		if (probe->timeout) {
+			wl_event_source_remove(probe->timeout);
+		}
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+		close(probe->fd);
+		free(probe);
+		return false;
+	}
+	wl_event_source_timer_update(probe->timeout, XWAYLAND_PROBE_TIMEOUT);
+
+	server->xwayland_probe = probe;
+	return true;
+}
+
+void
+xwayland_probe_cancel(struct cg_server *server)
+{
+	struct cg_xwayland_probe *probe = server->xwayland_probe;
+	if (!probe) {
+		return;
+	}
+
+	wl_event_source_remove(probe->readable);
+	wl_event_source_remove(probe->timeout);
+	kill(probe->pid, SIGKILL);
+	waitpid(probe->pid, NULL, 0);
+	close(probe->fd);
+	server->xwayland_probe = NULL;
+	free(probe);
+}
+
+int
+handle_xwayland_idle_timer(void *data)
+{
+	struct cg_server *server = data;
+
+	if (!xwayland_idle_pid(server) || server->xwayland_probe) {
+		return 0;
+	}
+
+	time_t uptime = time(NULL) - server->xwayland->server->server_start;
+	if (uptime <= XWAYLAND_MIN_UPTIME) {
+		wl_event_source_timer_update(server->xwayland_idle_timer, (XWAYLAND_MIN_UPTIME + 1 - uptime) * 1000);
+		return 0;
+	}
+
+	if (!xwayland_probe_start(server)) {
+		wl_event_source_timer_update(server->xwayland_idle_timer, server->xwayland_idle_timeout * 1000);
+	}
+	return 0;
+}
+
+void
+handle_xwayland_ready(struct wl_listener *listener, void *data)
+{
+	struct cg_server *server = wl_container_of(listener, server, xwayland_ready);
+
+	/* wlroots forgets the cursor when Xwayland exits, so it is set
+	   again on every launch. */
+	struct wlr_xcursor *xcursor =
+		wlr_xcursor_manager_get_xcursor(server->xwayland_xcursor_manager, DEFAULT_XCURSOR, 1);
+	if (xcursor) {
+		struct wlr_xcursor_image *image = xcursor->images[0];
+		wlr_xwayland_set_cursor(server->xwayland, image->buffer, image->width * 4, image->width, image->height,
+					image->hotspot_x, image->hotspot_y);
+	}
+
+	pid_t pid = xwayland_pid(server);
+	int64_t start_time = pid ? proc_age_nsec(pid) : -1;
+	if (start_time >= 0) {
+		event_stats_add(&server->xwayland_start_stats, start_time);
+		wlr_log(WLR_DEBUG, "Xwayland took %.1f ms to launch", start_time / 1e6);
+	}
+
+	/* A client that exits without ever mapping a window would
+	   otherwise keep Xwayland around. Clients that stay connected
+	   are found by the client count. */
+	if (server->xwayland_idle_timer && server->n_xwayland_surfaces == 0) {
+		wl_event_source_timer_update(server->xwayland_idle_timer, server->xwayland_idle_timeout * 1000);
+	}
+}
+
+void
+xwayland_log_statistics(struct cg_server *server)
+{
+	pid_t pid = xwayland_pid(server);
+	if (pid) {
+		wlr_log(WLR_INFO, "Xwayland: running with %ld KiB resident, %u windows, %u idle stops",
+			proc_rss_kib(pid), server->n_xwayland_surfaces, server->xwayland_idle_stops);
+	} else {
+		wlr_log(WLR_INFO, "Xwayland: not running, %u idle stops", server->xwayland_idle_stops);
+	}
+	event_stats_log(&server->xwayland_start_stats, "Xwayland launch");
+}
+
 struct cg_xwayland_view *
 xwayland_view_from_view(struct cg_view *view)
 {
 	return (struct cg_xwayland_view *) view;
 }
 
-bool
-xwayland_view_should_manage(struct cg_view *view)
+static void
+unmanaged_add_handling_time(struct cg_xwayland_unmanaged *unmanaged, const struct timespec *start)
 {
-	struct cg_xwayland_view *xwayland_view = xwayland_view_from_view(view);
-	struct wlr_xwayland_surface *xwayland_surface = xwayland_view->xwayland_surface;
-	return !xwayland_surface->override_redirect;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	unmanaged->handling_time += timespec_diff_nsec(&now, start);
+}
+
+static void
+unmanaged_damage(struct cg_xwayland_unmanaged *unmanaged, bool whole)
+{
+	struct cg_output *output;
+	wl_list_for_each (output, &unmanaged->server->outputs, link) {
+		output_damage_surface(output, unmanaged->xwayland_surface->surface, unmanaged->lx, unmanaged->ly,
+				      whole);
+	}
+}
+
+static void
+handle_unmanaged_request_configure(struct wl_listener *listener, void *data)
+{
+	struct cg_xwayland_unmanaged *unmanaged = wl_container_of(listener, unmanaged, request_configure);
+	struct wlr_xwayland_surface_configure_event *event = data;
+
+	wlr_xwayland_surface_configure(unmanaged->xwayland_surface, event->x, event->y, event->width,
+				       event->height);
+}
+
+static void
+handle_unmanaged_commit(struct wl_listener *listener, void *data)
+{
+	struct cg_xwayland_unmanaged *unmanaged = wl_container_of(listener, unmanaged, commit);
+	struct wlr_xwayland_surface *xwayland_surface = unmanaged->xwayland_surface;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (xwayland_surface->x != unmanaged->lx || xwayland_surface->y != unmanaged->ly) {
+		unmanaged_damage(unmanaged, true);
+		unmanaged->lx = xwayland_surface->x;
+		unmanaged->ly = xwayland_surface->y;
+		unmanaged_damage(unmanaged, true);
+	} else {
+		unmanaged_damage(unmanaged, false);
+	}
+
+	unmanaged_add_handling_time(unmanaged, &start);
+}
+
+static void handle_unmanaged_destroy(struct wl_listener *listener, void *data);
+static struct cg_xwayland_view *xwayland_view_create(struct cg_server *server,
+						     struct wlr_xwayland_surface *xwayland_surface);
+static void handle_xwayland_surface_map(struct wl_listener *listener, void *data);
+
+static void
+handle_unmanaged_map(struct wl_listener *listener, void *data)
+{
+	struct cg_xwayland_unmanaged *unmanaged = wl_container_of(listener, unmanaged, map);
+	struct wlr_xwayland_surface *xwayland_surface = unmanaged->xwayland_surface;
+	struct cg_server *server = unmanaged->server;
+
+	/* The window stopped being override-redirect after it was
+	   created, so it is managed as a view from now on. The map
+	   signal is emitted with wlr_signal_emit_safe, which doesn't
+	   call listeners added during the emission, so the view's map
+	   handler is called directly. */
+	if (!xwayland_surface->override_redirect) {
+		struct cg_xwayland_view *xwayland_view = xwayland_view_create(server, xwayland_surface);
+		handle_unmanaged_destroy(&unmanaged->destroy, NULL);
+		if (xwayland_view) {
+			handle_xwayland_surface_map(&xwayland_view->map, xwayland_surface);
+		}
+		return;
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	unmanaged->lx = xwayland_surface->x;
+	unmanaged->ly = xwayland_surface->y;
+	wl_list_insert(&server->xwayland_unmanaged, &unmanaged->link);
+
+	unmanaged->commit.notify = handle_unmanaged_commit;
+	wl_signal_add(&xwayland_surface->surface->events.commit, &unmanaged->commit);
+
+	unmanaged_damage(unmanaged, true);
+
+	/* Most override-redirect windows don't take input focus; the
+	   ones that do are given the keyboard, but don't become the
+	   focused view. */
+	if (wlr_xwayland_or_surface_wants_focus(xwayland_surface)) {
+		seat_focus_surface(server->seat, xwayland_surface->surface);
+	}
+
+	unmanaged_add_handling_time(unmanaged, &start);
+}
+
+static void
+handle_unmanaged_unmap(struct wl_listener *listener, void *data)
+{
+	struct cg_xwayland_unmanaged *unmanaged = wl_container_of(listener, unmanaged, unmap);
+	struct wlr_xwayland_surface *xwayland_surface = unmanaged->xwayland_surface;
+	struct cg_server *server = unmanaged->server;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	unmanaged_damage(unmanaged, true);
+
+	wl_list_remove(&unmanaged->link);
+	wl_list_remove(&unmanaged->commit.link);
+
+	/* Give the keyboard back to the focused view, or failing that
+	   to the top-most one. */
+	struct cg_seat *seat = server->seat;
+	if (seat->seat->keyboard_state.focused_surface == xwayland_surface->surface) {
+		if (seat->focused_view) {
+			seat_focus_surface(seat, seat->focused_view->wlr_surface);
+		} else if (!wl_list_empty(&server->views)) {
+			struct cg_view *view = wl_container_of(server->views.next, view, link);
+			seat_set_focus(seat, view);
+		}
+	}
+
+	unmanaged_add_handling_time(unmanaged, &start);
+}
+
+static void
+handle_unmanaged_destroy(struct wl_listener *listener, void *data)
+{
+	struct cg_xwayland_unmanaged *unmanaged = wl_container_of(listener, unmanaged, destroy);
+	struct cg_server *server = unmanaged->server;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	wl_list_remove(&unmanaged->request_configure.link);
+	wl_list_remove(&unmanaged->map.link);
+	wl_list_remove(&unmanaged->unmap.link);
+	wl_list_remove(&unmanaged->destroy.link);
+
+	unmanaged_add_handling_time(unmanaged, &start);
+	event_stats_add(&server->xwayland_unmanaged_stats, unmanaged->handling_time);
+	server->n_xwayland_unmanaged--;
+	xwayland_surface_destroyed(server);
+
+	free(unmanaged);
+}
+
+static struct cg_xwayland_unmanaged *
+xwayland_unmanaged_create(struct cg_server *server, struct wlr_xwayland_surface *xwayland_surface)
+{
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	struct cg_xwayland_unmanaged *unmanaged = calloc(1, sizeof(struct cg_xwayland_unmanaged));
+	if (!unmanaged) {
+		wlr_log(WLR_ERROR, "Failed to allocate XWayland override-redirect window");
+		return NULL;
+	}
+
+	unmanaged->server = server;
+	unmanaged->xwayland_surface = xwayland_surface;
+
+	unmanaged->request_configure.notify = handle_unmanaged_request_configure;
+	wl_signal_add(&xwayland_surface->events.request_configure, &unmanaged->request_configure);
+	unmanaged->map.notify = handle_unmanaged_map;
+	wl_signal_add(&xwayland_surface->events.map, &unmanaged->map);
+	unmanaged->unmap.notify = handle_unmanaged_unmap;
+	wl_signal_add(&xwayland_surface->events.unmap, &unmanaged->unmap);
+	unmanaged->destroy.notify = handle_unmanaged_destroy;
+	wl_signal_add(&xwayland_surface->events.destroy, &unmanaged->destroy);
+
+	server->n_xwayland_unmanaged++;
+	xwayland_surface_created(server);
+	unmanaged_add_handling_time(unmanaged, &start);
+	return unmanaged;
+}
+
+/* Returns the override-redirect surface under the layout coordinates
+ * lx and ly, if any, and sets sx and sy relative to it. */
+struct wlr_surface *
+xwayland_unmanaged_surface_at(struct cg_server *server, double lx, double ly, double *sx, double *sy)
+{
+	struct cg_xwayland_unmanaged *unmanaged;
+	wl_list_for_each (unmanaged, &server->xwayland_unmanaged, link) {
+		struct wlr_surface *surface = unmanaged->xwayland_surface->surface;
+		surface = wlr_surface_surface_at(surface, lx - unmanaged->lx, ly - unmanaged->ly, sx, sy);
+		if (surface) {
+			return surface;
+		}
+	}
+
+	return NULL;
 }
 
 static char *
@@ -121,6 +631,7 @@ handle_xwayland_surface_commit(struct wl_listener *listener, void *data)
 {
 	struct cg_xwayland_view *xwayland_view = wl_container_of(listener, xwayland_view, commit);
 	struct cg_view *view = &xwayland_view->view;
+	view_record_commit(view, view->wlr_surface);
 	view_damage_part(view);
 }
 
@@ -137,15 +648,27 @@ handle_xwayland_surface_unmap(struct wl_listener *listener, void *data)
 	view_unmap(view);
 }
 
+static void handle_xwayland_surface_destroy(struct wl_listener *listener, void *data);
+
 static void
 handle_xwayland_surface_map(struct wl_listener *listener, void *data)
 {
 	struct cg_xwayland_view *xwayland_view = wl_container_of(listener, xwayland_view, map);
 	struct cg_view *view = &xwayland_view->view;
+	struct wlr_xwayland_surface *xwayland_surface = xwayland_view->xwayland_surface;
 
-	if (!xwayland_view_should_manage(view)) {
-		view->lx = xwayland_view->xwayland_surface->x;
-		view->ly = xwayland_view->xwayland_surface->y;
+	/* The window was made override-redirect after it was created.
+	   As in handle_unmanaged_map, the listener added here won't be
+	   called by the ongoing map emission, so the handler is called
+	   directly. The new window is created before the view is
+	   destroyed so the window count never drops to zero. */
+	if (xwayland_surface->override_redirect) {
+		struct cg_xwayland_unmanaged *unmanaged = xwayland_unmanaged_create(view->server, xwayland_surface);
+		handle_xwayland_surface_destroy(&xwayland_view->destroy, NULL);
+		if (unmanaged) {
+			handle_unmanaged_map(&unmanaged->map, xwayland_surface);
+		}
+		return;
 	}
 
 	xwayland_view->commit.notify = handle_xwayland_surface_commit;
@@ -161,6 +684,7 @@ handle_xwayland_surface_destroy(struct wl_listener *listener, void *data)
 {
 	struct cg_xwayland_view *xwayland_view = wl_container_of(listener, xwayland_view, destroy);
 	struct cg_view *view = &xwayland_view->view;
+	struct cg_server *server = view->server;
 
 	wl_list_remove(&xwayland_view->map.link);
 	wl_list_remove(&xwayland_view->unmap.link);
@@ -169,6 +693,7 @@ handle_xwayland_surface_destroy(struct wl_listener *listener, void *data)
 	xwayland_view->xwayland_surface = NULL;
 
 	view_destroy(view);
+	xwayland_surface_destroyed(server);
 }
 
 static const struct cg_view_impl xwayland_view_impl = {
@@ -185,20 +710,18 @@ static const struct cg_view_impl xwayland_view_impl = {
 	.wlr_surface_at = wlr_surface_at,
 };
 
-void
-handle_xwayland_surface_new(struct wl_listener *listener, void *data)
+static struct cg_xwayland_view *
+xwayland_view_create(struct cg_server *server, struct wlr_xwayland_surface *xwayland_surface)
 {
-	struct cg_server *server = wl_container_of(listener, server, new_xwayland_surface);
-	struct wlr_xwayland_surface *xwayland_surface = data;
-
 	struct cg_xwayland_view *xwayland_view = calloc(1, sizeof(struct cg_xwayland_view));
 	if (!xwayland_view) {
 		wlr_log(WLR_ERROR, "Failed to allocate XWayland view");
-		return;
+		return NULL;
 	}
 
 	view_init(&xwayland_view->view, server, CAGE_XWAYLAND_VIEW, &xwayland_view_impl);
 	xwayland_view->xwayland_surface = xwayland_surface;
+	xwayland_surface_created(server);
 
 	xwayland_view->map.notify = handle_xwayland_surface_map;
 	wl_signal_add(&xwayland_surface->events.map, &xwayland_view->map);
@@ -208,4 +731,19 @@ handle_xwayland_surface_new(struct wl_listener *listener, void *data)
 	wl_signal_add(&xwayland_surface->events.destroy, &xwayland_view->destroy);
 	xwayland_view->request_fullscreen.notify = handle_xwayland_surface_request_fullscreen;
 	wl_signal_add(&xwayland_surface->events.request_fullscreen, &xwayland_view->request_fullscreen);
+
+	return xwayland_view;
+}
+
+void
+handle_xwayland_surface_new(struct wl_listener *listener, void *data)
+{
+	struct cg_server *server = wl_container_of(listener, server, new_xwayland_surface);
+	struct wlr_xwayland_surface *xwayland_surface = data;
+
+	if (xwayland_surface->override_redirect) {
+		xwayland_unmanaged_create(server, xwayland_surface);
+	} else {
+		xwayland_view_create(server, xwayland_surface);
+	}
 }
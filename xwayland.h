@@ -1,9 +1,13 @@
 #ifndef CG_XWAYLAND_H
 #define CG_XWAYLAND_H
 
+#include <stdint.h>
+#include <sys/types.h>
 #include <wayland-server-core.h>
+#include <wlr/types/wlr_surface.h>
 #include <wlr/xwayland.h>
 
+#include "server.h"
 #include "view.h"
 
 struct cg_xwayland_view {
@@ -16,8 +20,43 @@ struct cg_xwayland_view {
 	struct wl_listener request_fullscreen;
 };
 
+/* Override-redirect windows, such as menus and tooltips. They are
+ * placed by their client and drawn on top of all views, but are not
+ * managed as views themselves. */
+struct cg_xwayland_unmanaged {
+	struct cg_server *server;
+	struct wlr_xwayland_surface *xwayland_surface;
+	struct wl_list link; // server::xwayland_unmanaged
+
+	/* The window has a position in layout coordinates. */
+	int lx, ly;
+	/* Time spent handling the window's events. */
+	int64_t handling_time; // nsec
+
+	struct wl_listener request_configure;
+	struct wl_listener map;
+	struct wl_listener unmap;
+	struct wl_listener commit;
+	struct wl_listener destroy;
+};
+
+/* A child process counting Xwayland's clients before it is stopped. */
+struct cg_xwayland_probe {
+	struct cg_server *server;
+	pid_t pid;
+	int fd; // read end of the pipe the child answers on
+
+	struct wl_event_source *readable;
+	struct wl_event_source *timeout;
+};
+
 struct cg_xwayland_view *xwayland_view_from_view(struct cg_view *view);
-bool xwayland_view_should_manage(struct cg_view *view);
+struct wlr_surface *xwayland_unmanaged_surface_at(struct cg_server *server, double lx, double ly, double *sx,
+						  double *sy);
 void handle_xwayland_surface_new(struct wl_listener *listener, void *data);
+void handle_xwayland_ready(struct wl_listener *listener, void *data);
+int handle_xwayland_idle_timer(void *data);
+void xwayland_probe_cancel(struct cg_server *server);
+void xwayland_log_statistics(struct cg_server *server);
 
 #endif